@@ -0,0 +1,49 @@
+# Find a Unicode data file given in cache variable 'var', or download it
+# from 'url' (or from ${var}_URL if set) into the build directory.
+function(download_unicode_data var file_name url description)
+  set(${var} "${var}-NOTFOUND" CACHE FILEPATH "${description}")
+  option(CHECK_UNICODE_CERT "Check certificate while downloading Unicode data files" ON)
+
+  if(NOT ${var}_URL)
+    set(${var}_URL "${url}")
+  endif()
+
+  if(NOT ${var})
+    set(download_dest "${CMAKE_BINARY_DIR}/${file_name}")
+    message(STATUS "Downloading ${${var}_URL}...")
+    file(DOWNLOAD
+         "${${var}_URL}"
+         "${download_dest}"
+         SHOW_PROGRESS
+         STATUS status
+       TLS_VERIFY ${CHECK_UNICODE_CERT})
+
+    list(GET status 0 err)
+
+    if(err)
+      list(GET status 1 msg)
+      message(FATAL_ERROR "Download failed (${err}): ${msg}")
+    endif()
+
+    set(${var} "${download_dest}" CACHE FILEPATH "${description}" FORCE)
+  endif()
+
+  if(NOT EXISTS "${${var}}")
+    set(${var} "${var}-NOTFOUND" CACHE FILEPATH "${description}" FORCE)
+    message(FATAL_ERROR "${description} not found. "
+            "Use -D${var}=<path> or -D${var}_URL=<url> to specify location of this file.\n"
+            "${file_name} file is available at the Unicode web site: ${url}")
+  endif()
+endfunction()
+
+function(download_unicode_blocks)
+  download_unicode_data(UNICODE_BLOCKS Blocks.txt
+                        "https://unicode.org/Public/UNIDATA/Blocks.txt"
+                        "Unicode blocks file")
+endfunction()
+
+function(download_unicode_categories)
+  download_unicode_data(UNICODE_CATEGORIES DerivedGeneralCategory.txt
+                        "https://unicode.org/Public/UNIDATA/extracted/DerivedGeneralCategory.txt"
+                        "Unicode general categories file")
+endfunction()
@@ -0,0 +1,50 @@
+# Runs fntsample over every font in FONT_DIR and collects timings of its
+# phases into OUTPUT_DIR/timings.csv, and results of microbenchmarks into
+# OUTPUT_DIR/microbench.csv.
+#
+# Usage: cmake -DFNTSAMPLE=<path> -DMICROBENCH=<path> -DFONT_DIR=<dir>
+#              -DOUTPUT_DIR=<dir> -P RunBenchmark.cmake
+
+foreach(var FNTSAMPLE MICROBENCH FONT_DIR OUTPUT_DIR)
+  if(NOT ${var})
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+file(GLOB_RECURSE fonts LIST_DIRECTORIES false
+     "${FONT_DIR}/*.ttf" "${FONT_DIR}/*.otf" "${FONT_DIR}/*.ttc" "${FONT_DIR}/*.otc"
+     "${FONT_DIR}/*.TTF" "${FONT_DIR}/*.OTF" "${FONT_DIR}/*.TTC" "${FONT_DIR}/*.OTC")
+list(SORT fonts)
+
+if(NOT fonts)
+  message(FATAL_ERROR "No fonts found in ${FONT_DIR}. "
+          "Use -DFNTSAMPLE_BENCH_FONTS=<dir> to specify the font directory.")
+endif()
+
+file(MAKE_DIRECTORY "${OUTPUT_DIR}")
+set(timings "${OUTPUT_DIR}/timings.csv")
+file(REMOVE "${timings}")
+
+foreach(font IN LISTS fonts)
+  message(STATUS "Sampling ${font}")
+  execute_process(
+    COMMAND "${FNTSAMPLE}" -f "${font}" -o "${OUTPUT_DIR}/sample.pdf" -T "${timings}"
+    RESULT_VARIABLE result)
+
+  if(NOT result EQUAL 0)
+    message(WARNING "fntsample failed for ${font}: ${result}")
+  endif()
+endforeach()
+
+execute_process(
+  COMMAND "${MICROBENCH}" ${fonts}
+  OUTPUT_FILE "${OUTPUT_DIR}/microbench.csv"
+  RESULT_VARIABLE result)
+
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "Microbenchmarks failed: ${result}")
+endif()
+
+file(REMOVE "${OUTPUT_DIR}/sample.pdf")
+message(STATUS "Timings written to ${timings}")
+message(STATUS "Microbenchmark results written to ${OUTPUT_DIR}/microbench.csv")
@@ -0,0 +1,70 @@
+#! /usr/bin/env perl
+# Author: Ievgenii Meshcheriakov <eugen@debian.org>
+# SPDX-License-Identifier: CC-PDDC
+#
+# This program sends a job to fntsample running in server mode.
+# Usage: fntsample-client SOCKET [OPTIONS...]
+#
+# Options are passed to the server unchanged. The document is written to
+# the standard output and messages of the job to the standard error.
+# Exit status of the program is that of the job.
+
+use strict;
+use warnings;
+use IO::Socket::UNIX;
+use Locale::TextDomain('@CMAKE_PROJECT_NAME@', '@CMAKE_INSTALL_FULL_LOCALEDIR@');
+use POSIX qw(:locale_h);
+
+sub usage {
+    printf STDERR __"Usage: %s SOCKET [OPTIONS...]\n", $0;
+}
+
+# read exactly $len bytes from the server
+sub read_data {
+    my ($sock, $len) = @_;
+    my $data = q{};
+
+    while (length $data < $len) {
+        my $n = read $sock, $data, $len - length $data, length $data;
+        die __"Connection to the server was closed\n" unless $n;
+    }
+    return $data;
+}
+
+sub read_u32 {
+    my ($sock) = @_;
+
+    return unpack 'N', read_data($sock, 4);
+}
+
+setlocale(LC_ALL, q{});
+
+if ($#ARGV < 0) {
+    usage;
+    exit 1;
+}
+
+my ($socket_name, @args) = @ARGV;
+
+if (grep { /\0/ || $_ eq q{} } @args) {
+    die __"Options cannot be empty or contain zero bytes\n";
+}
+
+my $sock = IO::Socket::UNIX->new(Type => SOCK_STREAM, Peer => $socket_name)
+    or die __x("Cannot connect to '{socket}': {error}\n",
+               socket => $socket_name, error => $!);
+binmode $sock;
+binmode STDOUT;
+
+print {$sock} join(q{}, map { "$_\0" } @args), "\0";
+$sock->flush;
+
+while (my $len = read_u32($sock)) {
+    print read_data($sock, $len);
+}
+
+my $status = read_u32($sock);
+my $messages = read_data($sock, read_u32($sock));
+print STDERR $messages;
+
+exit $status;
@@ -0,0 +1,41 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef CHAR_CLASSES_H
+#define CHAR_CLASSES_H
+#include <stdint.h>
+
+/*
+ * Classes of characters that are drawn differently when missing from the font.
+ */
+enum char_class {
+    CHAR_ASSIGNED,  /* any assigned character except controls */
+    CHAR_UNDEFINED, /* unassigned code point or surrogate */
+    CHAR_CONTROL,   /* control character */
+};
+
+/*
+ * Classes are generated from DerivedGeneralCategory.txt at build time.
+ * The first stage maps a page of 256 characters to a row of the second
+ * stage. Each row holds classes of 256 characters, 2 bits per character,
+ * and identical rows are shared between pages.
+ */
+#define CHAR_CLASS_PAGES (0x110000 / 256)
+#define CHAR_CLASS_ROW_SIZE (256 / 4)
+
+extern const uint16_t static_char_class_pages[CHAR_CLASS_PAGES];
+extern const uint8_t static_char_class_rows[][CHAR_CLASS_ROW_SIZE];
+
+static inline enum char_class char_class(unsigned long charcode)
+{
+    if (charcode >= CHAR_CLASS_PAGES * 256) {
+        return CHAR_UNDEFINED;
+    }
+
+    uint16_t row = static_char_class_pages[charcode / 256];
+    uint8_t bits = static_char_class_rows[row][charcode % 256 / 4];
+    return (bits >> (charcode % 4 * 2)) & 3;
+}
+
+#endif
@@ -0,0 +1,207 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "coverage.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WORDS_PER_TABLE (COVERAGE_TABLE_SIZE / 64)
+
+static int lowest_bit(uint64_t word)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int n = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static int count_bits(uint64_t word)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    int n = 0;
+    for (; word; word &= word - 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Mask of bits from 'first' to 'last' within a word */
+static uint64_t word_mask(uint32_t first, uint32_t last)
+{
+    uint64_t mask = ~UINT64_C(0) << (first % 64);
+
+    if (last % 64 != 63) {
+        mask &= (UINT64_C(1) << (last % 64 + 1)) - 1;
+    }
+
+    return mask;
+}
+
+/*
+ * Find the first set bit with number not less than 'n' in the bitmap
+ * that consists of 'nwords' words.
+ *
+ * Returns number of the bit, or nwords * 64 if there are no more bits set.
+ */
+static uint32_t next_bit(const uint64_t *bitmap, uint32_t nwords, uint32_t n)
+{
+    uint32_t w = n / 64;
+
+    if (w >= nwords) {
+        return nwords * 64;
+    }
+
+    uint64_t word = bitmap[w] & (~UINT64_C(0) << (n % 64));
+
+    while (!word) {
+        if (++w == nwords) {
+            return nwords * 64;
+        }
+        word = bitmap[w];
+    }
+
+    return w * 64 + lowest_bit(word);
+}
+
+/*
+ * Build coverage of the given font face. This walks the character map
+ * of the face once, all further queries do not use FreeType.
+ */
+struct coverage *coverage_new(FT_Face face)
+{
+    struct coverage *cov = calloc(1, sizeof(struct coverage));
+    if (!cov) {
+        perror("calloc");
+        exit(9);
+    }
+
+    FT_UInt idx;
+    FT_ULong charcode = FT_Get_First_Char(face, &idx);
+
+    for (; idx; charcode = FT_Get_Next_Char(face, charcode, &idx)) {
+        if (charcode >= COVERAGE_SIZE) {
+            continue;
+        }
+
+        unsigned long table = charcode / COVERAGE_TABLE_SIZE;
+
+        if (!cov->glyphs[table]) {
+            cov->glyphs[table] = calloc(COVERAGE_TABLE_SIZE, sizeof(FT_UInt));
+            if (!cov->glyphs[table]) {
+                perror("calloc");
+                exit(9);
+            }
+            cov->tables[table / 64] |= UINT64_C(1) << (table % 64);
+        }
+
+        cov->glyphs[table][charcode % COVERAGE_TABLE_SIZE] = idx;
+        cov->chars[charcode / 64] |= UINT64_C(1) << (charcode % 64);
+        cov->nchars++;
+    }
+
+    return cov;
+}
+
+void coverage_free(struct coverage *cov)
+{
+    if (!cov) {
+        return;
+    }
+
+    for (int i = 0; i < COVERAGE_TABLES; i++) {
+        free(cov->glyphs[i]);
+    }
+
+    free(cov);
+}
+
+/*
+ * Find the first character with code not less than 'c'.
+ * Tables without characters are skipped without looking at their contents.
+ *
+ * Returns the character code or COVERAGE_END.
+ */
+uint32_t coverage_next(const struct coverage *cov, uint32_t c)
+{
+    while (c < COVERAGE_SIZE) {
+        uint32_t table = next_bit(cov->tables, COVERAGE_TABLES / 64, c / COVERAGE_TABLE_SIZE);
+        if (table >= COVERAGE_TABLES) {
+            break;
+        }
+
+        uint32_t table_start = table * COVERAGE_TABLE_SIZE;
+        if (c < table_start) {
+            c = table_start;
+        }
+
+        const uint64_t *words = cov->chars + table * WORDS_PER_TABLE;
+        uint32_t bit = next_bit(words, WORDS_PER_TABLE, c - table_start);
+        if (bit < COVERAGE_TABLE_SIZE) {
+            return table_start + bit;
+        }
+
+        c = table_start + COVERAGE_TABLE_SIZE;
+    }
+
+    return COVERAGE_END;
+}
+
+/*
+ * Find the first character not less than 'c' in a character bitmap
+ * of COVERAGE_WORDS words.
+ *
+ * Returns the character code or COVERAGE_END.
+ */
+uint32_t coverage_bits_next(const uint64_t *bits, uint32_t c)
+{
+    return next_bit(bits, COVERAGE_WORDS, c);
+}
+
+/*
+ * Count characters from 'first' to 'last' inclusive in a character bitmap.
+ */
+unsigned long coverage_bits_count(const uint64_t *bits, uint32_t first, uint32_t last)
+{
+    uint32_t w = first / 64;
+    uint32_t last_w = last / 64;
+
+    if (w == last_w) {
+        return count_bits(bits[w] & word_mask(first, last));
+    }
+
+    unsigned long n = count_bits(bits[w] & word_mask(first, 63));
+    while (++w < last_w) {
+        n += count_bits(bits[w]);
+    }
+
+    return n + count_bits(bits[w] & word_mask(0, last));
+}
+
+/*
+ * Add characters from 'first' to 'last' inclusive to a character bitmap.
+ */
+void coverage_bits_set_range(uint64_t *bits, uint32_t first, uint32_t last)
+{
+    uint32_t w = first / 64;
+    uint32_t last_w = last / 64;
+
+    if (w == last_w) {
+        bits[w] |= word_mask(first, last);
+        return;
+    }
+
+    bits[w] |= word_mask(first, 63);
+    while (++w < last_w) {
+        bits[w] = ~UINT64_C(0);
+    }
+    bits[w] |= word_mask(0, last);
+}
@@ -0,0 +1,65 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+// TODO: freetype 2.10.3, do not include ft2build.h anymore
+#include <ft2build.h>
+#include <freetype/freetype.h>
+
+/* Number of Unicode code points */
+#define COVERAGE_SIZE 0x110000
+/* Returned by coverage_next() when there are no more characters */
+#define COVERAGE_END COVERAGE_SIZE
+
+#define COVERAGE_TABLE_SIZE 0x100
+#define COVERAGE_TABLES (COVERAGE_SIZE / COVERAGE_TABLE_SIZE)
+#define COVERAGE_WORDS (COVERAGE_SIZE / 64)
+
+/*
+ * Set of Unicode characters supported by a font face, together with
+ * glyph indices for them. Glyph indices are stored per table of 256
+ * code points, only for tables that have at least one character.
+ */
+struct coverage {
+    uint64_t chars[COVERAGE_WORDS];
+    uint64_t tables[COVERAGE_TABLES / 64]; /* tables with at least one character */
+    FT_UInt *glyphs[COVERAGE_TABLES];
+    unsigned long nchars;
+};
+
+struct coverage *coverage_new(FT_Face face);
+void coverage_free(struct coverage *cov);
+uint32_t coverage_next(const struct coverage *cov, uint32_t c);
+
+/* Operations on character bitmaps of COVERAGE_WORDS words, like coverage.chars */
+uint32_t coverage_bits_next(const uint64_t *bits, uint32_t c);
+unsigned long coverage_bits_count(const uint64_t *bits, uint32_t first, uint32_t last);
+void coverage_bits_set_range(uint64_t *bits, uint32_t first, uint32_t last);
+
+/*
+ * Check if the character with the given code is present.
+ */
+static inline bool coverage_has(const struct coverage *cov, uint32_t c)
+{
+    return c < COVERAGE_SIZE && (cov->chars[c / 64] >> (c % 64)) & 1;
+}
+
+/*
+ * Get glyph index for the character with the given code.
+ * Returns 0 if the character is not present.
+ */
+static inline FT_UInt coverage_glyph(const struct coverage *cov, uint32_t c)
+{
+    if (!coverage_has(cov, c)) {
+        return 0;
+    }
+
+    return cov->glyphs[c / COVERAGE_TABLE_SIZE][c % COVERAGE_TABLE_SIZE];
+}
+
+#endif
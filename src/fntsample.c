@@ -1,7 +1,6 @@
 /* Copyright © Євгеній Мещеряков <eugen@debian.org>
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
-#include <assert.h>
 // TODO: freetype 2.10.3, do not include ft2build.h anymore
 #include <ft2build.h>
 #include <freetype/freetype.h>
@@ -16,16 +15,31 @@
 #include <glib.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 #include <getopt.h>
 #include <stdint.h>
 #include <pango/pangocairo.h>
 #include <pango/pangofc-fontmap.h>
+#include <fontconfig/fcfreetype.h>
 #include <math.h>
 #include <libintl.h>
 #include <locale.h>
 
 #include "unicode_blocks.h"
 #include "static_unicode_blocks.h"
+#include "char_classes.h"
+#include "coverage.h"
+#include "ranges.h"
+#include "page_cache.h"
+#include "report.h"
+#include "glyph_diff.h"
+#include "glyph_paths.h"
+#include "timing.h"
+#include "stats.h"
+#include "stream_writer.h"
+#include "serve.h"
 #include "config.h"
 
 #define _(str) gettext(str)
@@ -46,8 +60,10 @@ static double cell_y(int pos) { return ymin_border + cell_height * (pos % 16); }
 
 static struct option longopts[] = {
     {"blocks-file", 1, 0, 'b'},
+    {"blocks-cache", 1, 0, 'B'},
     {"font-file", 1, 0, 'f'},
     {"output-file", 1, 0, 'o'},
+    {"output-fd", 1, 0, 'F'},
     {"help", 0, 0, 'h'},
     {"other-font-file", 1, 0, 'd'},
     {"postscript-output", 0, 0, 's'},
@@ -60,29 +76,83 @@ static struct option longopts[] = {
     {"font-index", 1, 0, 'n'},
     {"other-index", 1, 0, 'm'},
     {"no-embed", 0, 0, 'e'},
-    {"use-pango", 0, 0, 'p'}, /* For compatibility with version <= 5.3 */
+    {"use-pango", 0, 0, 'p'},
+    {"jobs", 1, 0, 'j'},
+    {"png", 0, 0, 'r'},
+    {"resolution", 1, 0, 'R'},
+    {"cache-dir", 1, 0, 'C'},
+    {"split", 1, 0, 'S'},
+    {"manifest", 1, 0, 'M'},
+    {"coverage-report", 1, 0, 'c'},
+    {"changed-only", 0, 0, 'D'},
+    {"all-faces", 0, 0, 'A'},
+    {"timings", 1, 0, 'T'},
+    {"stats", 1, 0, 'u'},
+    {"progress", 1, 0, 'P'},
+    {"label-font-file", 1, 0, 'L'},
+    {"serve", 1, 0, 'k'},
+    {"formats", 1, 0, 'O'},
+    {"overview", 1, 0, 'H'},
     {0, 0, 0, 0},
 };
 
-struct range {
-    uint32_t first;
-    uint32_t last;
-    bool include;
-    struct range *next;
+enum output_format {
+    FORMAT_PDF,
+    FORMAT_PS,
+    FORMAT_SVG,
+    FORMAT_PNG,
+    FORMATS,
 };
 
+/* Format names used in --formats are the extensions without the dot */
+static const char *const format_extensions[FORMATS] = {".pdf", ".ps", ".svg", ".png"};
+
+enum overview_mode {
+    OVERVIEW_NONE,
+    OVERVIEW_FIRST, /* overview pages before the tables */
+    OVERVIEW_ONLY,
+};
+
+enum split_mode {
+    SPLIT_NONE,
+    SPLIT_BLOCK,
+    SPLIT_PAGE,
+    SPLIT_FACE,
+};
+
+static const char *blocks_file_name;
+static const char *blocks_cache_name;
 static const char *font_file_name;
 static const char *other_font_file_name;
 static const char *output_file_name;
-static bool postscript_output;
-static bool svg_output;
+/* Output is written to this descriptor instead of a named file if not -1 */
+static int output_fd = -1;
+/* Bit mask of requested output formats */
+static unsigned int formats;
+static int nformats;
+static double resolution = 150;
+static const char *cache_dir;
+static enum split_mode split_mode;
+static const char *manifest_file_name;
+static enum report_format report_format;
+static bool changed_only;
+static enum overview_mode overview_mode;
+static const char *timings_file_name;
+static const char *stats_file_name;
 static bool print_outline;
 static bool write_outline;
 static bool no_embed;
-static struct range *ranges;
-static struct range *last_range;
+static bool use_pango;
 static int font_index;
 static int other_index;
+static bool other_index_given;
+static bool all_faces;
+static int jobs;
+static const char *serve_socket_name;
+/* Set while options of a job received by the server are parsed */
+static bool in_job;
+/* Fonts for headers and labels given with -L, system fonts are used if NULL */
+static FcConfig *label_fc_config;
 
 struct fntsample_style {
     const char *const name;
@@ -95,6 +165,7 @@ static struct fntsample_style styles[] = {
     {"font-name-font", "Serif Bold 12", NULL},
     {"table-numbers-font", "Sans 10", NULL},
     {"cell-numbers-font", "Mono 8", NULL},
+    {"overview-font", "Sans 6", NULL},
     {NULL, NULL, NULL},
 };
 
@@ -103,16 +174,76 @@ struct table_fonts {
     PangoFontDescription *font_name;
     PangoFontDescription *table_numbers;
     PangoFontDescription *cell_numbers;
+    PangoFontDescription *overview;
 };
 
 static struct table_fonts table_fonts;
 
+/*
+ * Shaped glyphs of a hexadecimal digit.
+ */
+struct digit_glyphs {
+    int nglyphs;
+    cairo_glyph_t *glyphs; /* positions are relative to the digit origin */
+    cairo_scaled_font_t **fonts;
+    int width;          /* advance in Pango units */
+    PangoRectangle ink; /* ink extents relative to the digit origin */
+};
+
+/*
+ * Digits shaped once for the given label style. Labels with
+ * character codes are drawn from these glyphs without using Pango.
+ */
+struct label_font {
+    struct digit_glyphs digits[16];
+    int baseline;
+};
+
+static struct label_font table_numbers_label;
+static struct label_font cell_numbers_label;
+
+/*
+ * A single page of the output, showing up to 256 characters of
+ * one Unicode block.
+ */
+struct table_page {
+    const struct unicode_block *block;
+    unsigned long tbl_start;
+    unsigned long tbl_end;
+};
+
+struct page_list {
+    struct table_page *pages;
+    int n;
+    int nalloc;
+};
+
 static double cell_label_offset;
 static double cell_glyph_bot_offset;
 static double glyph_baseline_offset;
 static double font_scale;
+static cairo_scaled_font_t *glyph_font;
+/* Outlines of glyph_font for --no-embed, NULL otherwise */
+static struct glyph_paths *glyph_paths;
+/* Characters with different glyphs in the other font */
+static uint64_t *changed_glyphs;
 
 static const struct unicode_block *unicode_blocks;
+static int nunicode_blocks;
+/* Lookup table for the blocks, binary search is used if there is none */
+static struct block_lookup block_lookup;
+
+/* Documents written by an unsplit run, one for each requested format */
+struct output {
+    enum output_format format;
+    struct stream_writer *writer;
+    cairo_t *cr;
+};
+
+static struct output outputs[FORMATS];
+static int noutputs;
+
+static FT_Library ft_library;
 
 static void usage(const char *);
 
@@ -172,139 +303,362 @@ static int parse_style_string(char *s)
 }
 
 /*
- * Update output range.
+ * Locate the first character from the given coverage with code not
+ * less than 'charcode', that belongs to the output range specified
+ * by the user.
  *
- * Returns -1 on error.
+ * Returns character code or COVERAGE_END if there are no more characters.
  */
-static int add_range(char *range, bool include)
+static uint32_t next_char_in_ranges(const struct coverage *cov, uint32_t charcode)
 {
-    uint32_t first = 0, last = 0xffffffff;
-    char *endptr;
-
-    char *minus = strchr(range, '-');
+    for (;;) {
+        charcode = coverage_next(cov, charcode);
+        if (charcode == COVERAGE_END) {
+            return COVERAGE_END;
+        }
 
-    if (minus) {
-        if (minus != range) {
-            *minus = '\0';
-            first = strtoul(range, &endptr, 0);
-            if (*endptr) {
-                return -1;
-            }
+        const struct range *r = find_range(charcode);
+        if (!r) {
+            return COVERAGE_END;
         }
 
-        if (*(minus + 1)) {
-            last = strtoul(minus + 1, &endptr, 0);
-            if (*endptr) {
-                return -1;
-            }
-        } else if (minus == range) {
-            return -1;
+        if (charcode >= r->first) {
+            return charcode;
         }
-    } else {
-        first = strtoul(range, &endptr, 0);
-        if (*endptr)
-            return -1;
-        last = first;
+
+        /* skip to the next selected range */
+        charcode = r->first;
     }
+}
 
-    if (first > last) {
-        return -1;
+/*
+ * Find the first character to show with code not less than 'charcode'.
+ * In comparison mode characters from both fonts are shown.
+ */
+static uint32_t get_next_char(const struct coverage *cov, const struct coverage *other_cov,
+                              uint32_t charcode)
+{
+    uint32_t c = next_char_in_ranges(cov, charcode);
+
+    if (other_cov) {
+        uint32_t other_c = next_char_in_ranges(other_cov, charcode);
+        if (other_c < c) {
+            c = other_c;
+        }
     }
 
-    struct range *r = malloc(sizeof(*r));
-    if (!r) {
-        return -1;
+    return c;
+}
+
+/*
+ * Set up the default font map of the calling thread.
+ * Pango keeps a separate default font map for each thread.
+ */
+static void init_font_map(void)
+{
+    /* FIXME is this correct? */
+    PangoCairoFontMap *map = (PangoCairoFontMap *)pango_cairo_font_map_get_default();
+
+    pango_cairo_font_map_set_resolution(map, POINTS_PER_INCH);
+}
+
+/*
+ * Create Pango layout for the given text.
+ * Updates 'r' with text extents.
+ * Returned layout should be freed using g_object_unref().
+ */
+static PangoLayout *layout_text(cairo_t *cr, PangoFontDescription *ftdesc, const char *text,
+                                PangoRectangle *r)
+{
+    PangoLayout *layout = pango_cairo_create_layout(cr);
+    stats_add(STATS_LAYOUTS, 1);
+    pango_layout_set_font_description(layout, ftdesc);
+    pango_layout_set_text(layout, text, -1);
+    pango_layout_get_extents(layout, r, NULL);
+
+    return layout;
+}
+
+#define hexdigs "0123456789ABCDEF"
+
+/*
+ * Shape all hexadecimal digits using the given font description
+ * and store the result in 'lf'.
+ */
+static void init_label_font(cairo_t *cr, PangoFontDescription *ftdesc, struct label_font *lf)
+{
+    PangoRectangle r;
+    PangoLayout *layout = layout_text(cr, ftdesc, hexdigs, &r);
+    lf->baseline = pango_layout_get_baseline(layout);
+    g_object_unref(layout);
+
+    for (int i = 0; i < 16; i++) {
+        const char buf[2] = {hexdigs[i], '\0'};
+        struct digit_glyphs *d = lf->digits + i;
+
+        layout = layout_text(cr, ftdesc, buf, &r);
+        PangoLayoutLine *line = pango_layout_get_line_readonly(layout, 0);
+        pango_layout_line_get_extents(line, &d->ink, NULL);
+
+        int nglyphs = 0;
+        for (GSList *l = line->runs; l; l = l->next) {
+            nglyphs += ((PangoGlyphItem *)l->data)->glyphs->num_glyphs;
+        }
+
+        d->glyphs = calloc(nglyphs, sizeof(cairo_glyph_t));
+        d->fonts = calloc(nglyphs, sizeof(cairo_scaled_font_t *));
+        if (nglyphs && (!d->glyphs || !d->fonts)) {
+            perror("calloc");
+            exit(9);
+        }
+
+        int x = 0;
+        d->nglyphs = 0;
+        for (GSList *l = line->runs; l; l = l->next) {
+            PangoGlyphItem *run = l->data;
+            cairo_scaled_font_t *scaled_font
+                = pango_cairo_font_get_scaled_font(PANGO_CAIRO_FONT(run->item->analysis.font));
+
+            for (int j = 0; j < run->glyphs->num_glyphs; j++) {
+                const PangoGlyphInfo *gi = run->glyphs->glyphs + j;
+
+                if (gi->glyph != PANGO_GLYPH_EMPTY && !(gi->glyph & PANGO_GLYPH_UNKNOWN_FLAG)) {
+                    cairo_glyph_t *g = d->glyphs + d->nglyphs;
+                    g->index = gi->glyph;
+                    g->x = pango_units_to_double(x + gi->geometry.x_offset);
+                    g->y = pango_units_to_double(gi->geometry.y_offset);
+                    d->fonts[d->nglyphs++] = cairo_scaled_font_reference(scaled_font);
+                }
+
+                x += gi->geometry.width;
+            }
+        }
+        d->width = x;
+
+        g_object_unref(layout);
     }
+}
 
-    r->first = first;
-    r->last = last;
-    r->include = include;
-    r->next = NULL;
+static int hex_value(char c)
+{
+    return strchr(hexdigs, c) - hexdigs;
+}
 
-    if (ranges) {
-        last_range->next = r;
-    } else {
-        ranges = r;
+/*
+ * Calculate ink extents of a label, as pango_layout_get_extents()
+ * would do for a layout with the same text.
+ */
+static void label_extents(const struct label_font *lf, const char *text, PangoRectangle *r)
+{
+    int x = 0;
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    bool empty = true;
+
+    for (const char *p = text; *p; p++) {
+        const struct digit_glyphs *d = lf->digits + hex_value(*p);
+
+        if (d->ink.width > 0 && d->ink.height > 0) {
+            int dx0 = x + d->ink.x;
+            int dx1 = dx0 + d->ink.width;
+            int dy0 = d->ink.y;
+            int dy1 = dy0 + d->ink.height;
+
+            x0 = empty ? dx0 : MIN(x0, dx0);
+            y0 = empty ? dy0 : MIN(y0, dy0);
+            x1 = empty ? dx1 : MAX(x1, dx1);
+            y1 = empty ? dy1 : MAX(y1, dy1);
+            empty = false;
+        }
+
+        x += d->width;
     }
 
-    last_range = r;
+    r->x = x0;
+    r->y = y0 + lf->baseline;
+    r->width = x1 - x0;
+    r->height = y1 - y0;
+}
 
-    return 0;
+/*
+ * Draw label with the baseline starting at the current point.
+ * Consecutive glyphs using the same font are drawn with a single call.
+ */
+static void show_label(cairo_t *cr, const struct label_font *lf, const char *text)
+{
+    cairo_glyph_t glyphs[16];
+    cairo_scaled_font_t *font = NULL;
+    int n = 0;
+    double x, y;
+
+    cairo_get_current_point(cr, &x, &y);
+
+    for (const char *p = text; *p; p++) {
+        const struct digit_glyphs *d = lf->digits + hex_value(*p);
+
+        for (int i = 0; i < d->nglyphs; i++) {
+            if (n == G_N_ELEMENTS(glyphs) || (n && d->fonts[i] != font)) {
+                cairo_set_scaled_font(cr, font);
+                cairo_show_glyphs(cr, glyphs, n);
+                n = 0;
+            }
+
+            font = d->fonts[i];
+            glyphs[n] = d->glyphs[i];
+            glyphs[n].x += x;
+            glyphs[n].y += y;
+            n++;
+        }
+
+        x += pango_units_to_double(d->width);
+    }
+
+    if (n) {
+        cairo_set_scaled_font(cr, font);
+        cairo_show_glyphs(cr, glyphs, n);
+    }
 }
 
 /*
- * Check if character with the given code belongs
- * to output range specified by the user.
+ * Check that output file name template for split output only uses known
+ * sequences: %n for file number, %b for block name, %r for character range,
+ * %f for face index and %% for a percent sign. Files with whole faces
+ * can only use %f.
  */
-static bool in_range(uint32_t c)
+static bool check_file_name_template(const char *template)
 {
-    bool in = ranges ? (!ranges->include) : 1;
+    const char *sequences = split_mode == SPLIT_FACE ? "f%" : "nbrf%";
 
-    for (struct range *r = ranges; r; r = r->next) {
-        if ((c >= r->first) && (c <= r->last)) {
-            in = r->include;
+    for (const char *p = template; *p; p++) {
+        if (*p == '%' && (!*++p || !strchr(sequences, *p))) {
+            return false;
         }
     }
-    return in;
+
+    return true;
 }
 
 /*
- * Get glyph index for the next glyph from the given font face, that
- * represents character from output range specified by the user.
- *
- * Returns character code, updates 'idx'.
- * 'idx' can became 0 if there are no more glyphs.
+ * Check that a template checked with check_file_name_template() gives
+ * different names to all split output files. Templates without any
+ * sequences always do, the file number is added to them.
  */
-static FT_ULong get_next_char(FT_Face face, FT_ULong charcode, FT_UInt *idx)
+static bool file_name_template_is_unique(const char *template)
 {
-    FT_ULong rval = charcode;
+    bool uses_sequences = false;
+    bool has_file = false;
+    bool has_face = false;
 
-    do {
-        rval = FT_Get_Next_Char(face, rval, idx);
-    } while (*idx && !in_range(rval));
+    for (const char *p = template; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
 
-    return rval;
+        uses_sequences = true;
+        switch (*++p) {
+        case 'n':
+        case 'r':
+            has_file = true;
+            break;
+        case 'b':
+            has_file = has_file || split_mode == SPLIT_BLOCK;
+            break;
+        case 'f':
+            has_face = true;
+            break;
+        }
+    }
+
+    if (split_mode == SPLIT_FACE) {
+        has_file = true;
+    }
+
+    return !uses_sequences || (has_file && (has_face || !all_faces));
 }
 
 /*
- * Locate first character from the given font face that belongs
- * to the user-specified output range.
- *
- * Returns character code, updates 'idx' with glyph index.
- * Glyph index can became 0 if there are no matching glyphs in the font.
+ * Load blocks given with -b. If a cache file is given, blocks are mapped
+ * from it when it is up to date, otherwise it is written after the blocks
+ * file is parsed.
  */
-static FT_ULong get_first_char(FT_Face face, FT_UInt *idx)
+static void load_blocks(void)
 {
-    FT_ULong rval = FT_Get_First_Char(face, idx);
+    struct unicode_block *blocks = NULL;
+    int n = 0;
+
+    if (blocks_cache_name) {
+        blocks = read_blocks_cache(blocks_cache_name, blocks_file_name, &n, &block_lookup);
+    }
+
+    if (!blocks) {
+        blocks = read_blocks(blocks_file_name, &n);
+        if (n == 0) {
+            fprintf(stderr, _("Failed to load any blocks from the blocks file!\n"));
+            exit(6);
+        }
 
-    if (*idx && !in_range(rval)) {
-        rval = get_next_char(face, rval, idx);
+        if (sort_blocks(blocks, n)) {
+            fprintf(stderr, _("Blocks in the blocks file overlap or have invalid ranges!\n"));
+            exit(6);
+        }
+
+        if (blocks_cache_name
+            && write_blocks_cache(blocks_cache_name, blocks_file_name, blocks, n)) {
+            fprintf(stderr, _("Failed to write blocks cache %s!\n"), blocks_cache_name);
+        }
     }
 
-    return rval;
+    unicode_blocks = blocks;
+    nunicode_blocks = n;
 }
 
+static bool has_format(enum output_format format) { return formats & (1 << format); }
+
 /*
- * Create Pango layout for the given text.
- * Updates 'r' with text extents.
- * Returned layout should be freed using g_object_unref().
+ * Add formats from a comma separated list to the requested formats.
+ * Returns -1 if the list contains unknown formats.
  */
-static PangoLayout *layout_text(cairo_t *cr, PangoFontDescription *ftdesc, const char *text,
-                                PangoRectangle *r)
+static int parse_formats(const char *list)
 {
-    PangoLayout *layout = pango_cairo_create_layout(cr);
-    pango_layout_set_font_description(layout, ftdesc);
-    pango_layout_set_text(layout, text, -1);
-    pango_layout_get_extents(layout, r, NULL);
+    char **names = g_strsplit(list, ",", -1);
+    int ret = 0;
 
-    return layout;
+    for (char **name = names; *name; name++) {
+        int i = 0;
+        while (i < FORMATS && strcmp(*name, format_extensions[i] + 1)) {
+            i++;
+        }
+
+        if (i == FORMATS) {
+            ret = -1;
+            break;
+        }
+        formats |= 1 << i;
+    }
+
+    g_strfreev(names);
+    return ret;
+}
+
+/*
+ * Exit if an option that writes server-side files or descriptors was
+ * given in a request to the server.
+ */
+static void reject_in_job(const char *option)
+{
+    if (in_job) {
+        fprintf(stderr, _("%s cannot be used in a job!\n"), option);
+        exit(1);
+    }
 }
 
 static void parse_options(int argc, char *const argv[])
 {
     for (;;) {
         int n;
-        int c = getopt_long(argc, argv, "b:f:o:hd:sglwi:x:t:n:m:ep", longopts, NULL);
+        char *endptr;
+        int c = getopt_long(argc, argv,
+                            "b:B:f:o:F:hd:sglwi:x:t:n:m:epj:rR:C:S:M:c:DAT:u:P:L:k:O:H:", longopts,
+                            NULL);
 
         if (c == -1) {
             break;
@@ -312,16 +666,18 @@ static void parse_options(int argc, char *const argv[])
 
         switch (c) {
         case 'b':
-            if (unicode_blocks) {
+            if (blocks_file_name) {
                 fprintf(stderr, _("Unicode blocks file should be given at most once!\n"));
                 exit(1);
             }
-
-            unicode_blocks = read_blocks(optarg, &n);
-            if (n == 0) {
-                fprintf(stderr, _("Failed to load any blocks from the blocks file!\n"));
-                exit(6);
-            }
+            blocks_file_name = optarg;
+            /* Blocks preloaded by the server are replaced */
+            unicode_blocks = NULL;
+            nunicode_blocks = 0;
+            break;
+        case 'B':
+            reject_in_job("--blocks-cache");
+            blocks_cache_name = optarg;
             break;
         case 'f':
             if (font_file_name) {
@@ -337,6 +693,14 @@ static void parse_options(int argc, char *const argv[])
             }
             output_file_name = optarg;
             break;
+        case 'F':
+            n = strtol(optarg, &endptr, 10);
+            if (*endptr || n < 0 || fcntl(n, F_GETFD) < 0) {
+                fprintf(stderr, _("Output should be written to an open file descriptor!\n"));
+                exit(1);
+            }
+            output_fd = n;
+            break;
         case 'h':
             usage(argv[0]);
             exit(0);
@@ -349,10 +713,91 @@ static void parse_options(int argc, char *const argv[])
             other_font_file_name = optarg;
             break;
         case 's':
-            postscript_output = true;
+            formats |= 1 << FORMAT_PS;
             break;
         case 'g':
-            svg_output = true;
+            formats |= 1 << FORMAT_SVG;
+            break;
+        case 'r':
+            formats |= 1 << FORMAT_PNG;
+            break;
+        case 'O':
+            if (parse_formats(optarg)) {
+                fprintf(stderr, _("Formats should be a comma separated list of pdf, ps, svg "
+                                  "and png!\n"));
+                exit(1);
+            }
+            break;
+        case 'R':
+            resolution = strtod(optarg, &endptr);
+            if (*endptr || resolution <= 0) {
+                fprintf(stderr, _("Resolution should be a positive number!\n"));
+                exit(1);
+            }
+            break;
+        case 'C':
+            reject_in_job("--cache-dir");
+            cache_dir = optarg;
+            break;
+        case 'S':
+            if (!strcmp(optarg, "block")) {
+                split_mode = SPLIT_BLOCK;
+            } else if (!strcmp(optarg, "page")) {
+                split_mode = SPLIT_PAGE;
+            } else if (!strcmp(optarg, "face")) {
+                split_mode = SPLIT_FACE;
+            } else {
+                fprintf(stderr, _("Split mode should be one of block, page or face!\n"));
+                exit(1);
+            }
+            break;
+        case 'M':
+            reject_in_job("--manifest");
+            manifest_file_name = optarg;
+            break;
+        case 'D':
+            changed_only = true;
+            break;
+        case 'H':
+            if (!strcmp(optarg, "first")) {
+                overview_mode = OVERVIEW_FIRST;
+            } else if (!strcmp(optarg, "only")) {
+                overview_mode = OVERVIEW_ONLY;
+            } else {
+                fprintf(stderr, _("Overview mode should be either first or only!\n"));
+                exit(1);
+            }
+            break;
+        case 'A':
+            all_faces = true;
+            break;
+        case 'T':
+            reject_in_job("--timings");
+            timings_file_name = optarg;
+            break;
+        case 'u':
+            reject_in_job("--stats");
+            stats_file_name = optarg;
+            stats_enable();
+            break;
+        case 'P':
+            reject_in_job("--progress");
+            n = strtol(optarg, &endptr, 10);
+            if (*endptr || n < 0 || fcntl(n, F_GETFD) < 0) {
+                fprintf(stderr, _("Progress should be written to an open file descriptor!\n"));
+                exit(1);
+            }
+            progress_open(n);
+            break;
+        case 'c':
+            if (!strcmp(optarg, "json")) {
+                report_format = REPORT_JSON;
+            } else if (!strcmp(optarg, "csv")) {
+                report_format = REPORT_CSV;
+            } else {
+                fprintf(stderr, _("Report format should be either json or csv!\n"));
+                exit(1);
+            }
             break;
         case 'l':
             print_outline = true;
@@ -378,12 +823,43 @@ static void parse_options(int argc, char *const argv[])
             break;
         case 'm':
             other_index = atoi(optarg);
+            other_index_given = true;
             break;
         case 'e':
             no_embed = true;
             break;
         case 'p':
-            /* Ignored for compatibility */
+            use_pango = true;
+            break;
+        case 'L':
+            if (in_job) {
+                fprintf(stderr, _("Label font files can only be given to the server!\n"));
+                exit(1);
+            }
+            if (!label_fc_config) {
+                label_fc_config = FcConfigCreate();
+            }
+            if (!FcConfigAppFontAddFile(label_fc_config, (const FcChar8 *)optarg)) {
+                fprintf(stderr, _("Failed to load label font file %s!\n"), optarg);
+                exit(4);
+            }
+            break;
+        case 'j':
+            jobs = strtol(optarg, &endptr, 10);
+            if (*endptr || jobs < 0) {
+                fprintf(stderr, _("Number of jobs should be a non-negative integer!\n"));
+                exit(1);
+            }
+            if (jobs == 0) {
+                jobs = g_get_num_processors();
+            }
+            break;
+        case 'k':
+            if (in_job) {
+                fprintf(stderr, _("--serve cannot be used in a job!\n"));
+                exit(1);
+            }
+            serve_socket_name = optarg;
             break;
         case '?':
         default:
@@ -393,105 +869,243 @@ static void parse_options(int argc, char *const argv[])
         }
     }
 
-    if (!font_file_name || !output_file_name) {
+    if (serve_socket_name) {
+        if (font_file_name || other_font_file_name || output_file_name || output_fd >= 0) {
+            fprintf(stderr, _("Font and output files cannot be given with --serve!\n"));
+            exit(1);
+        }
+    } else if (!font_file_name || (!output_file_name && output_fd < 0)) {
         usage(argv[0]);
         exit(1);
     }
 
+    if (output_file_name && output_fd >= 0) {
+        fprintf(stderr, _("-o and -F cannot be used together!\n"));
+        exit(1);
+    }
+
+    if (output_file_name && !strcmp(output_file_name, "-")) {
+        output_fd = STDOUT_FILENO;
+    }
+
     if (font_index < 0 || other_index < 0) {
         fprintf(stderr, _("Font index should be non-negative!\n"));
         exit(1);
     }
 
-    if (postscript_output && svg_output) {
-        fprintf(stderr, _("-s and -g cannot be used together!\n"));
+    /* Ranges given to the server are completed by each job */
+    if (!serve_socket_name && finish_ranges()) {
+        perror("malloc");
         exit(1);
     }
 
-    if (!unicode_blocks) {
-        unicode_blocks = static_unicode_blocks;
+    if (!formats) {
+        formats = 1 << FORMAT_PDF;
     }
-}
 
-/*
- * Locate unicode block that contains given character code.
- * Returns this block or NULL if not found.
- */
-static const struct unicode_block *get_unicode_block(unsigned long charcode)
-{
-    for (const struct unicode_block *block = unicode_blocks; block->name; block++) {
-        if ((charcode >= block->start) && (charcode <= block->end)) {
-            return block;
+    nformats = 0;
+    for (int i = 0; i < FORMATS; i++) {
+        nformats += has_format(i);
+    }
+
+    if (has_format(FORMAT_PNG)) {
+        if (split_mode == SPLIT_BLOCK || split_mode == SPLIT_FACE) {
+            fprintf(stderr, _("PNG output can only be split by page!\n"));
+            exit(1);
         }
+        /* Each page of PNG output is always written to its own file */
+        split_mode = SPLIT_PAGE;
     }
 
-    return NULL;
-}
+    if (has_format(FORMAT_SVG) && (split_mode == SPLIT_BLOCK || split_mode == SPLIT_FACE)) {
+        fprintf(stderr, _("SVG output can only be split by page!\n"));
+        exit(1);
+    }
 
-/*
- * Check if the given character code belongs to the given Unicode block.
- */
-static bool is_in_block(unsigned long charcode, const struct unicode_block *block)
-{
-    return ((charcode >= block->start) && (charcode <= block->end));
-}
+    if (changed_only && !other_font_file_name) {
+        fprintf(stderr, _("--changed-only can only be used with --other-font-file!\n"));
+        exit(1);
+    }
 
-/*
- * Format and print/write outline information, if requested by the user.
- */
-static void outline(cairo_surface_t *surface, int level, int page, const char *text)
-{
-    if (print_outline) {
-        printf("%d %d %s\n", level, page, text);
+    if ((split_mode == SPLIT_NONE || split_mode == SPLIT_FACE)
+        && (cache_dir || manifest_file_name)) {
+        fprintf(stderr, _("--cache-dir and --manifest can only be used with block or page split "
+                          "or PNG output!\n"));
+        exit(1);
     }
 
-    if (write_outline && cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_PDF) {
-        int len = snprintf(0, 0, "page=%d", page);
-        char *dest = malloc(len + 1);
-        sprintf(dest, "page=%d", page);
+    if (output_fd >= 0 && split_mode != SPLIT_NONE) {
+        fprintf(stderr, _("Split and PNG output cannot be written to a file descriptor!\n"));
+        exit(1);
+    }
 
-        /* FIXME passing level here is not correct. */
-        cairo_pdf_surface_add_outline(surface, level, text, dest, CAIRO_PDF_OUTLINE_FLAG_OPEN);
-        free(dest);
+    if (overview_mode != OVERVIEW_NONE && split_mode != SPLIT_NONE) {
+        fprintf(stderr, _("--overview cannot be used with split or PNG output!\n"));
+        exit(1);
     }
-}
 
-/*
- * Draw header of a page.
- * Header shows font name and current Unicode block.
- */
-static void draw_header(cairo_t *cr, const char *face_name, const char *block_name)
-{
-    PangoRectangle r;
+    if (output_fd >= 0 && nformats > 1) {
+        fprintf(stderr, _("Several formats cannot be written to a file descriptor!\n"));
+        exit(1);
+    }
 
-    PangoLayout *layout = layout_text(cr, table_fonts.font_name, face_name, &r);
-    cairo_move_to(cr, (A4_WIDTH - pango_units_to_double(r.width)) / 2.0, 30.0);
-    pango_cairo_show_layout_line(cr, pango_layout_get_line_readonly(layout, 0));
-    g_object_unref(layout);
+    if (output_fd == STDOUT_FILENO && print_outline) {
+        fprintf(stderr, _("-l cannot be used when output is written to standard output!\n"));
+        exit(1);
+    }
 
-    layout = layout_text(cr, table_fonts.header, block_name, &r);
-    cairo_move_to(cr, (A4_WIDTH - pango_units_to_double(r.width)) / 2.0, 50.0);
+    if (split_mode != SPLIT_NONE && !check_file_name_template(output_file_name)) {
+        fprintf(stderr, _("Output file name template uses unsupported sequences!\n"));
+        exit(1);
+    }
+
+    if (split_mode != SPLIT_NONE && !file_name_template_is_unique(output_file_name)) {
+        fprintf(stderr, _("Output file name template does not give unique names to all files!\n"));
+        exit(1);
+    }
+
+    if (all_faces && (report_format != REPORT_NONE || manifest_file_name)) {
+        fprintf(stderr, _("--all-faces cannot be used with --coverage-report or --manifest!\n"));
+        exit(1);
+    }
+
+    if (stats_file_name && all_faces && split_mode != SPLIT_NONE) {
+        fprintf(stderr, _("--stats cannot be used with --all-faces and --split!\n"));
+        exit(1);
+    }
+
+    /*
+     * Label fonts are looked up in the default Fontconfig configuration.
+     * Making the configuration with the given files current before anything
+     * uses Fontconfig avoids loading the system configuration and fonts.
+     */
+    if (label_fc_config && !FcConfigSetCurrent(label_fc_config)) {
+        fprintf(stderr, _("Failed to set up label fonts!\n"));
+        exit(4);
+    }
+
+    if (blocks_cache_name && !blocks_file_name) {
+        fprintf(stderr, _("--blocks-cache can only be used with --blocks-file!\n"));
+        exit(1);
+    }
+
+    if (unicode_blocks) {
+        /* Blocks were loaded by the server */
+        return;
+    }
+
+    if (blocks_file_name) {
+        load_blocks();
+    } else {
+        unicode_blocks = static_unicode_blocks;
+        while (unicode_blocks[nunicode_blocks].name) {
+            nunicode_blocks++;
+        }
+        block_lookup.pages = static_unicode_block_pages;
+        block_lookup.rows = static_unicode_block_rows;
+    }
+}
+
+/*
+ * Locate unicode block that contains given character code.
+ * Returns this block or NULL if not found.
+ */
+static const struct unicode_block *get_unicode_block(unsigned long charcode)
+{
+    if (block_lookup.pages) {
+        int i = block_lookup_index(&block_lookup, charcode);
+        return i < 0 ? NULL : unicode_blocks + i;
+    }
+
+    return find_block(unicode_blocks, nunicode_blocks, charcode);
+}
+
+/*
+ * Check if the given character code belongs to the given Unicode block.
+ */
+static bool is_in_block(unsigned long charcode, const struct unicode_block *block)
+{
+    return ((charcode >= block->start) && (charcode <= block->end));
+}
+
+/*
+ * Write document outline entry to a PDF surface.
+ * Returns id of the new entry, to be used as parent of nested entries.
+ */
+static int add_pdf_outline(cairo_surface_t *surface, int parent, int page, const char *text)
+{
+    int id = CAIRO_PDF_OUTLINE_ROOT;
+
+    if (write_outline && cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_PDF) {
+        int len = snprintf(0, 0, "page=%d", page);
+        char *dest = malloc(len + 1);
+        sprintf(dest, "page=%d", page);
+
+        id = cairo_pdf_surface_add_outline(surface, parent, text, dest,
+                                           CAIRO_PDF_OUTLINE_FLAG_OPEN);
+        free(dest);
+    }
+
+    return id;
+}
+
+/*
+ * Format and print/write outline information, if requested by the user.
+ * Entries are for a face (level 0) or a Unicode block (level 1), blocks
+ * are nested under the last face.
+ */
+static void outline(int level, int page, const char *text)
+{
+    static int face_outline = CAIRO_PDF_OUTLINE_ROOT;
+
+    if (print_outline) {
+        printf("%d %d %s\n", level, page, text);
+    }
+
+    for (int i = 0; i < noutputs; i++) {
+        if (outputs[i].format != FORMAT_PDF) {
+            continue;
+        }
+
+        cairo_surface_t *surface = cairo_get_target(outputs[i].cr);
+        if (level == 0) {
+            face_outline = add_pdf_outline(surface, CAIRO_PDF_OUTLINE_ROOT, page, text);
+        } else {
+            add_pdf_outline(surface, face_outline, page, text);
+        }
+    }
+}
+
+/*
+ * Draw the first line of page header, that shows font name.
+ */
+static void draw_font_name(cairo_t *cr, const char *face_name)
+{
+    PangoRectangle r;
+
+    PangoLayout *layout = layout_text(cr, table_fonts.font_name, face_name, &r);
+    cairo_move_to(cr, (A4_WIDTH - pango_units_to_double(r.width)) / 2.0, 30.0);
     pango_cairo_show_layout_line(cr, pango_layout_get_line_readonly(layout, 0));
     g_object_unref(layout);
 }
 
 /*
- * Highlight the cell with given coordinates.
- * Used to highlight new glyphs.
+ * Draw the second line of page header, that shows current Unicode block.
  */
-static void highlight_cell(cairo_t *cr, double x, double y)
+static void draw_block_name(cairo_t *cr, const char *block_name)
 {
-    cairo_save(cr);
-    cairo_set_source_rgb(cr, 1.0, 1.0, 0.6);
-    cairo_rectangle(cr, x, y, cell_width, cell_height);
-    cairo_fill(cr);
-    cairo_restore(cr);
+    PangoRectangle r;
+
+    PangoLayout *layout = layout_text(cr, table_fonts.header, block_name, &r);
+    cairo_move_to(cr, (A4_WIDTH - pango_units_to_double(r.width)) / 2.0, 50.0);
+    pango_cairo_show_layout_line(cr, pango_layout_get_line_readonly(layout, 0));
+    g_object_unref(layout);
 }
 
 /*
- * Draw table grid with row and column numbers.
+ * Draw table grid with row numbers.
  */
-static void draw_grid(cairo_t *cr, unsigned int x_cells, unsigned long block_start)
+static void draw_grid(cairo_t *cr, unsigned int x_cells)
 {
     const double x_min = (A4_WIDTH - x_cells * cell_width) / 2;
     const double x_max = (A4_WIDTH + x_cells * cell_width) / 2;
@@ -523,52 +1137,186 @@ static void draw_grid(cairo_t *cr, unsigned int x_cells, unsigned long block_sta
     /* draw glyph numbers */
     char buf[17];
     buf[1] = '\0';
-#define hexdigs "0123456789ABCDEF"
 
     for (int i = 0; i < 16; i++) {
         buf[0] = hexdigs[i];
 
         PangoRectangle r;
-        PangoLayout *layout = layout_text(cr, table_fonts.table_numbers, buf, &r);
+        label_extents(&table_numbers_label, buf, &r);
         cairo_move_to(cr, x_min - pango_units_to_double(PANGO_RBEARING(r)) - 5.0,
                       POINTS_PER_INCH + (i + 0.5) * table_height / 16
                           + pango_units_to_double(PANGO_DESCENT(r)) / 2);
-        pango_cairo_show_layout_line(cr, pango_layout_get_line_readonly(layout, 0));
+        show_label(cr, &table_numbers_label, buf);
         cairo_move_to(cr, x_min + x_cells * cell_width + 5.0,
                       POINTS_PER_INCH + (i + 0.5) * table_height / 16
                           + pango_units_to_double(PANGO_DESCENT(r)) / 2);
-        pango_cairo_show_layout_line(cr, pango_layout_get_line_readonly(layout, 0));
-        g_object_unref(layout);
+        show_label(cr, &table_numbers_label, buf);
     }
+}
+
+/*
+ * Draw column numbers of the table.
+ */
+static void draw_column_labels(cairo_t *cr, unsigned int x_cells, unsigned long block_start)
+{
+    const double x_min = (A4_WIDTH - x_cells * cell_width) / 2;
+    char buf[17];
 
     for (unsigned int i = 0; i < x_cells; i++) {
         snprintf(buf, sizeof(buf), "%03lX", block_start / 16 + i);
 
         PangoRectangle r;
-        PangoLayout *layout = layout_text(cr, table_fonts.table_numbers, buf, &r);
+        label_extents(&table_numbers_label, buf, &r);
         cairo_move_to(cr,
                       x_min + i * cell_width + (cell_width - pango_units_to_double(r.width)) / 2,
                       ymin_border - 5.0);
-        pango_cairo_show_layout_line(cr, pango_layout_get_line_readonly(layout, 0));
-        g_object_unref(layout);
+        show_label(cr, &table_numbers_label, buf);
+    }
+}
+
+/*
+ * Kinds of table cells, all cells except normal glyphs have background.
+ */
+enum cell_type {
+    CELL_GLYPH,         /* glyph present in the font */
+    CELL_NEW_GLYPH,     /* glyph missing from the other font */
+    CELL_CHANGED_GLYPH, /* glyph different in the other font */
+    CELL_REMOVED_GLYPH, /* glyph present only in the other font */
+    CELL_UNDEFINED,     /* character not defined in Unicode */
+    CELL_CONTROL,       /* control character */
+    CELL_MISSING,       /* character missing from the font */
+    CELL_TYPES,
+};
+
+static const double cell_colors[CELL_TYPES][3] = {
+    [CELL_NEW_GLYPH] = {1.0, 1.0, 0.6},
+    [CELL_CHANGED_GLYPH] = {0.7, 0.9, 1.0},
+    [CELL_REMOVED_GLYPH] = {1.0, 0.7, 0.7},
+    [CELL_UNDEFINED] = {0.0, 0.0, 0.0},
+    [CELL_CONTROL] = {0.0, 0.0, 0.5},
+    [CELL_MISSING] = {0.5, 0.5, 0.5},
+};
+
+/*
+ * Type of the cell for a character missing from the font.
+ * It depends on the character class in the Unicode version used for the build.
+ */
+static enum cell_type empty_cell_type(unsigned long charcode)
+{
+    static const enum cell_type types[] = {
+        [CHAR_ASSIGNED] = CELL_MISSING,
+        [CHAR_UNDEFINED] = CELL_UNDEFINED,
+        [CHAR_CONTROL] = CELL_CONTROL,
+    };
+
+    return types[char_class(charcode)];
+}
+
+/*
+ * Find type of the cell for the given character. In comparison mode
+ * added, changed and removed glyphs get their own types.
+ */
+static enum cell_type cell_type(const struct coverage *cov, const struct coverage *other_cov,
+                                uint32_t charcode)
+{
+    if (!in_range(charcode)) {
+        return empty_cell_type(charcode);
+    }
+
+    if (coverage_has(cov, charcode)) {
+        if (!other_cov) {
+            return CELL_GLYPH;
+        } else if (!coverage_has(other_cov, charcode)) {
+            return CELL_NEW_GLYPH;
+        } else if ((changed_glyphs[charcode / 64] >> (charcode % 64)) & 1) {
+            return CELL_CHANGED_GLYPH;
+        } else {
+            return CELL_GLYPH;
+        }
+    }
+
+    if (other_cov && coverage_has(other_cov, charcode)) {
+        return CELL_REMOVED_GLYPH;
+    }
+
+    return empty_cell_type(charcode);
+}
+
+/* Check if the cell shows a glyph of the font */
+static bool has_glyph(enum cell_type type)
+{
+    return type == CELL_GLYPH || type == CELL_NEW_GLYPH || type == CELL_CHANGED_GLYPH;
+}
+
+/* Check if the cell shows a charcode */
+static bool has_charcode(enum cell_type type)
+{
+    return has_glyph(type) || type == CELL_REMOVED_GLYPH;
+}
+
+static bool column_has_type(const enum cell_type *cells, int pos, enum cell_type type)
+{
+    for (int i = pos; i < pos + 16; i++) {
+        if (cells[i] != type) {
+            return false;
+        }
     }
+
+    return true;
 }
 
 /*
- * Fill empty cell. Color of the fill depends on the character properties.
+ * Fill backgrounds of the cells. Cells of the same type are filled
+ * with a single path. Adjacent cells in a column, and adjacent columns
+ * that are completely of the same type, are merged into one rectangle.
+ * Returns number of filled rectangles.
  */
-static void fill_empty_cell(cairo_t *cr, double x, double y, unsigned long charcode)
+static int fill_cells(cairo_t *cr, double x_min, const enum cell_type *cells, int ncells)
 {
+    int nfills = 0;
+
     cairo_save(cr);
-    if (g_unichar_isdefined(charcode)) {
-        if (g_unichar_iscntrl(charcode))
-            cairo_set_source_rgb(cr, 0.0, 0.0, 0.5);
-        else
-            cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
-    }
-    cairo_rectangle(cr, x, y, cell_width, cell_height);
-    cairo_fill(cr);
+
+    for (enum cell_type type = CELL_NEW_GLYPH; type < CELL_TYPES; type++) {
+        bool empty = true;
+
+        for (int pos = 0; pos < ncells;) {
+            if (cells[pos] != type) {
+                pos++;
+                continue;
+            }
+
+            int end = pos + 1;
+            while (end < ncells && end % 16 && cells[end] == type) {
+                end++;
+            }
+
+            double width = cell_width;
+            double height = (end - pos) * cell_height;
+
+            if (pos % 16 == 0 && end - pos == 16) {
+                while (end + 16 <= ncells && column_has_type(cells, end, type)) {
+                    end += 16;
+                    width += cell_width;
+                }
+            }
+
+            cairo_rectangle(cr, cell_x(x_min, pos), cell_y(pos), width, height);
+            nfills++;
+            empty = false;
+            pos = end;
+        }
+
+        if (!empty) {
+            cairo_set_source_rgb(cr, cell_colors[type][0], cell_colors[type][1],
+                                 cell_colors[type][2]);
+            cairo_fill(cr);
+        }
+    }
+
     cairo_restore(cr);
+
+    return nfills;
 }
 
 /*
@@ -580,173 +1328,1609 @@ static void draw_charcode(cairo_t *cr, double x, double y, FT_ULong charcode)
     snprintf(buf, sizeof(buf), "%04lX", charcode);
 
     PangoRectangle r;
-    PangoLayout *layout = layout_text(cr, table_fonts.cell_numbers, buf, &r);
+    label_extents(&cell_numbers_label, buf, &r);
     cairo_move_to(cr, x + (cell_width - pango_units_to_double(r.width)) / 2.0,
                   y + cell_height - cell_label_offset);
-    pango_cairo_show_layout_line(cr, pango_layout_get_line_readonly(layout, 0));
-    g_object_unref(layout);
+    show_label(cr, &cell_numbers_label, buf);
 }
 
 /*
- * Draws tables for all characters in the given Unicode block.
- * Use font described by face and ft_face. Start from character
- * with given charcode (it should belong to the given Unicode
- * block). After return 'charcode' equals the last character code
- * of the block.
- *
- * Returns number of pages drawn.
+ * Page elements that are the same on all pages with the given number
+ * of table columns: font name, table grid and row numbers. They are
+ * recorded once and painted on each page. A recording is only replayed
+ * by one thread at a time, threads writing split output have their own.
+ */
+struct page_chrome {
+    cairo_surface_t *pages[17];
+    struct page_chrome *next; /* next unused chrome of a split job */
+};
+
+static struct page_chrome page_chrome;
+
+/*
+ * Paint the common page elements over the current page.
  */
-static int draw_unicode_block(cairo_t *cr, PangoLayout *layout, FT_Face ft_face,
-                              const char *font_name, unsigned long charcode,
-                              const struct unicode_block *block, FT_Face ft_other_face)
+static void draw_page_chrome(cairo_t *cr, struct page_chrome *chrome, const char *font_name,
+                             unsigned int x_cells)
 {
-    int npages = 0;
-    FT_UInt idx = FT_Get_Char_Index(ft_face, charcode);
+    if (!chrome->pages[x_cells]) {
+        const cairo_rectangle_t extents = {0, 0, A4_WIDTH, A4_HEIGHT};
+        chrome->pages[x_cells]
+            = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+
+        cairo_t *chrome_cr = cairo_create(chrome->pages[x_cells]);
+        draw_font_name(chrome_cr, font_name);
+        draw_grid(chrome_cr, x_cells);
+        cairo_destroy(chrome_cr);
+    }
 
-    do {
-        unsigned long offset = ((charcode - block->start) / 0x100) * 0x100;
-        unsigned long tbl_start = block->start + offset;
-        unsigned long tbl_end = tbl_start + 0xFF > block->end ? block->end + 1 : tbl_start + 0x100;
-        unsigned int rows = (tbl_end - tbl_start) / 16;
-        double x_min = (A4_WIDTH - rows * cell_width) / 2;
+    cairo_save(cr);
+    cairo_set_source_surface(cr, chrome->pages[x_cells], 0.0, 0.0);
+    cairo_paint(cr);
+    cairo_restore(cr);
+}
+
+/*
+ * Copy a page drawn on a recording surface to all outputs, add the
+ * common page elements and start a new page.
+ */
+static void show_page(cairo_surface_t *recording, const char *font_name, unsigned int x_cells)
+{
+    for (int i = 0; i < noutputs; i++) {
+        cairo_t *cr = outputs[i].cr;
+
+        cairo_save(cr);
+        cairo_set_source_surface(cr, recording, 0.0, 0.0);
+        cairo_paint(cr);
+        cairo_restore(cr);
+        draw_page_chrome(cr, &page_chrome, font_name, x_cells);
+        cairo_show_page(cr);
+    }
+}
+
+static void free_page_chrome(struct page_chrome *chrome)
+{
+    for (unsigned int i = 0; i < G_N_ELEMENTS(chrome->pages); i++) {
+        if (chrome->pages[i]) {
+            cairo_surface_destroy(chrome->pages[i]);
+            chrome->pages[i] = NULL;
+        }
+    }
+}
+
+static unsigned int table_columns(const struct table_page *page)
+{
+    return (page->tbl_end - page->tbl_start) / 16;
+}
+
+/*
+ * Draw a character in the cell with given coordinates using Pango.
+ */
+static void draw_glyph_layout(cairo_t *cr, PangoLayout *layout, double x, double y,
+                              uint32_t charcode)
+{
+    char buf[9];
+    gint len = g_unichar_to_utf8((gunichar)charcode, buf);
+    pango_layout_set_text(layout, buf, len);
+
+    double baseline = pango_units_to_double(pango_layout_get_baseline(layout));
+    cairo_move_to(cr, x, y + glyph_baseline_offset - baseline);
+
+    if (no_embed) {
+        pango_cairo_layout_path(cr, layout);
+        cairo_fill(cr);
+    } else {
+        pango_cairo_show_layout(cr, layout);
+    }
+}
+
+/*
+ * Draws table for a single page. Glyphs are drawn by their indices
+ * from cov using glyph_font, or with Pango if layout is not NULL.
+ * The page should contain at least one character from either font.
+ * Differences from other_cov are highlighted. Common page
+ * elements are not drawn, use draw_page_chrome() for them.
+ * Time spent drawing is accounted to the block in statistics.
+ */
+static void draw_table(cairo_t *cr, PangoLayout *layout, const struct coverage *cov,
+                       const struct table_page *page, const struct coverage *other_cov)
+{
+    const struct unicode_block *block = page->block;
+    unsigned long tbl_start = page->tbl_start;
+    unsigned long tbl_end = page->tbl_end;
+    unsigned int rows = table_columns(page);
+    double x_min = (A4_WIDTH - rows * cell_width) / 2;
+    int ncells = tbl_end - tbl_start;
+
+    enum cell_type cells[256]; /* 16x16 glyphs max */
+    cairo_glyph_t glyphs[256];
+    int nglyphs = 0;
+    int nlayouts = 0;
+    int ncharcodes = 0;
+    int64_t start = g_get_monotonic_time();
+
+    draw_block_name(cr, block->name);
+
+    /*
+     * Find types of all cells. Cells that differ from the other font are highlighted.
+     */
+    for (int pos = 0; pos < ncells; pos++) {
+        cells[pos] = cell_type(cov, other_cov, tbl_start + pos);
+    }
+
+    stats_add(STATS_FILLS, fill_cells(cr, x_min, cells, ncells));
+
+    /* draw the characters */
+    for (int pos = 0; pos < ncells; pos++) {
+        if (!has_glyph(cells[pos])) {
+            continue;
+        }
+
+        if (layout) {
+            draw_glyph_layout(cr, layout, cell_x(x_min, pos), cell_y(pos), tbl_start + pos);
+            nlayouts++;
+        } else {
+            cairo_glyph_t *g = glyphs + nglyphs++;
+            cairo_text_extents_t extents;
+
+            g->index = coverage_glyph(cov, tbl_start + pos);
+            g->x = 0.0;
+            g->y = 0.0;
+            cairo_scaled_font_glyph_extents(glyph_font, g, 1, &extents);
+            g->x = cell_x(x_min, pos) + (cell_width - extents.x_advance) / 2.0;
+            g->y = cell_y(pos) + glyph_baseline_offset;
+        }
+    }
+
+    /* All glyphs of the page are drawn with a single call */
+    if (nglyphs) {
+        cairo_set_scaled_font(cr, glyph_font);
+
+        if (no_embed) {
+            glyph_paths_append(glyph_paths, cr, glyphs, nglyphs);
+            cairo_fill(cr);
+        } else {
+            cairo_show_glyphs(cr, glyphs, nglyphs);
+        }
+    }
+
+    /*
+     * Charcodes are drawn here to avoid switching between the charcode
+     * font and the cell font for each filled cell.
+     */
+    for (int pos = 0; pos < ncells; pos++) {
+        if (has_charcode(cells[pos])) {
+            draw_charcode(cr, cell_x(x_min, pos), cell_y(pos), tbl_start + pos);
+            ncharcodes++;
+        }
+    }
+
+    draw_column_labels(cr, rows, tbl_start);
+
+    stats_add(STATS_GLYPHS, nglyphs + nlayouts);
+    stats_add(STATS_CHARCODES, ncharcodes);
+    stats_page(font_index, block, nglyphs + nlayouts, g_get_monotonic_time() - start);
+}
+
+#define UNICODE_PLANES 17
+#define PLANE_SIZE 0x10000
+
+/* Overview pages show a plane as 256 rows of 256 small squares */
+#define overview_cell (POINTS_PER_INCH / 48.0)
+#define overview_size (256 * overview_cell)
+#define overview_x_min POINTS_PER_INCH
+#define overview_y_min ymin_border
+
+static const char *const plane_names[UNICODE_PLANES] = {
+    [0] = "Basic Multilingual Plane",
+    [1] = "Supplementary Multilingual Plane",
+    [2] = "Supplementary Ideographic Plane",
+    [3] = "Tertiary Ideographic Plane",
+    [14] = "Supplementary Special-purpose Plane",
+    [15] = "Supplementary Private Use Area-A",
+    [16] = "Supplementary Private Use Area-B",
+};
+
+/*
+ * Returns header of the overview page of the plane.
+ * Returned string should be freed using g_free().
+ */
+static char *plane_name(int plane)
+{
+    if (plane_names[plane]) {
+        return g_strdup_printf("Plane %d: %s", plane, plane_names[plane]);
+    } else {
+        return g_strdup_printf("Plane %d", plane);
+    }
+}
+
+/*
+ * Find planes that contain characters to show.
+ * Returns bit mask of the planes.
+ */
+static unsigned int overview_planes(const struct coverage *cov, const struct coverage *other_cov)
+{
+    unsigned int planes = 0;
+    uint32_t charcode = get_next_char(cov, other_cov, 0);
+
+    while (charcode != COVERAGE_END) {
+        int plane = charcode / PLANE_SIZE;
+        planes |= 1u << plane;
+        charcode = get_next_char(cov, other_cov, (plane + 1) * PLANE_SIZE);
+    }
+
+    return planes;
+}
+
+/* Overview squares use the colors of table cells, glyphs are white */
+static void set_overview_color(cairo_t *cr, enum cell_type type)
+{
+    if (type == CELL_GLYPH) {
+        cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    } else {
+        cairo_set_source_rgb(cr, cell_colors[type][0], cell_colors[type][1], cell_colors[type][2]);
+    }
+}
+
+static uint32_t overview_pixel(enum cell_type type)
+{
+    if (type == CELL_GLYPH) {
+        return 0xFFFFFF;
+    }
+
+    const double *c = cell_colors[type];
+    return (uint32_t)lround(c[0] * 255) << 16 | (uint32_t)lround(c[1] * 255) << 8
+           | (uint32_t)lround(c[2] * 255);
+}
+
+/*
+ * Draw a square for each character of the plane. Squares are pixels of
+ * an image that is scaled without smoothing, so pages stay small and fast
+ * to draw whatever the number of characters.
+ */
+static void draw_plane_squares(cairo_t *cr, const struct coverage *cov,
+                               const struct coverage *other_cov, uint32_t plane_start)
+{
+    uint32_t pixels[CELL_TYPES];
+    for (int i = 0; i < CELL_TYPES; i++) {
+        pixels[i] = overview_pixel(i);
+    }
+
+    cairo_surface_t *image = cairo_image_surface_create(CAIRO_FORMAT_RGB24, 256, 256);
+    cairo_status_t status = cairo_surface_status(image);
+    if (status != CAIRO_STATUS_SUCCESS) {
+        fprintf(stderr, "cairo_image_surface_create: %s\n", cairo_status_to_string(status));
+        exit(9);
+    }
+
+    unsigned char *data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    cairo_surface_flush(image);
+    for (int row = 0; row < 256; row++) {
+        uint32_t *line = (uint32_t *)(data + row * stride);
+
+        for (int col = 0; col < 256; col++) {
+            line[col] = pixels[cell_type(cov, other_cov, plane_start + row * 256 + col)];
+        }
+    }
+    cairo_surface_mark_dirty(image);
+
+    cairo_save(cr);
+    cairo_translate(cr, overview_x_min, overview_y_min);
+    cairo_scale(cr, overview_cell, overview_cell);
+    cairo_set_source_surface(cr, image, 0.0, 0.0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+    cairo_paint(cr);
+    cairo_restore(cr);
+
+    cairo_surface_destroy(image);
+}
+
+/*
+ * Add path separating characters before and after 'pos' in the plane.
+ */
+static void overview_boundary(cairo_t *cr, uint32_t pos)
+{
+    if (pos == 0 || pos >= PLANE_SIZE) {
+        return;
+    }
+
+    const double x_max = overview_x_min + overview_size;
+    double x = overview_x_min + (pos % 256) * overview_cell;
+    double y = overview_y_min + (pos / 256) * overview_cell;
+
+    if (pos % 256 == 0) {
+        cairo_move_to(cr, overview_x_min, y);
+        cairo_line_to(cr, x_max, y);
+    } else {
+        cairo_move_to(cr, x_max, y);
+        cairo_line_to(cr, x, y);
+        cairo_line_to(cr, x, y + overview_cell);
+        cairo_line_to(cr, overview_x_min, y + overview_cell);
+    }
+}
+
+/*
+ * Find part of the block in the plane. Returns false if there is none.
+ */
+static bool block_in_plane(const struct unicode_block *block, uint32_t plane_start,
+                           uint32_t *first, uint32_t *last)
+{
+    if (block->end < plane_start || block->start >= plane_start + PLANE_SIZE) {
+        return false;
+    }
+
+    *first = MAX(block->start, plane_start) - plane_start;
+    *last = MIN(block->end, plane_start + PLANE_SIZE - 1) - plane_start;
+    return true;
+}
+
+/*
+ * Draw block boundaries and names of the blocks at their first rows.
+ * Names that would overlap the previous one are left out.
+ */
+static void draw_plane_blocks(cairo_t *cr, uint32_t plane_start)
+{
+    const double x_max = overview_x_min + overview_size;
+    const double name_width = A4_WIDTH - x_max - xmin_border / 2 - 7.0;
+    uint32_t first, last;
+
+    cairo_save(cr);
+    cairo_set_source_rgb(cr, 0.8, 0.0, 0.0);
+    cairo_set_line_width(cr, 0.5);
+    for (int i = 0; i < nunicode_blocks; i++) {
+        if (block_in_plane(unicode_blocks + i, plane_start, &first, &last)) {
+            overview_boundary(cr, first);
+            overview_boundary(cr, last + 1);
+        }
+    }
+    cairo_stroke(cr);
+    cairo_restore(cr);
+
+    double name_height = 0.0;
+    double next_y = 0.0;
+
+    cairo_set_line_width(cr, 0.5);
+    for (int i = 0; i < nunicode_blocks; i++) {
+        if (!block_in_plane(unicode_blocks + i, plane_start, &first, &last)) {
+            continue;
+        }
+
+        double y = overview_y_min + (first / 256) * overview_cell;
+        if (y - name_height / 2 < next_y) {
+            continue;
+        }
+
+        PangoRectangle r;
+        PangoLayout *layout = layout_text(cr, table_fonts.overview, unicode_blocks[i].name, &r);
+        pango_layout_set_width(layout, pango_units_from_double(name_width));
+        pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
+        name_height = pango_units_to_double(r.height);
+
+        cairo_move_to(cr, x_max, y);
+        cairo_line_to(cr, x_max + 5.0, y);
+        cairo_stroke(cr);
+        cairo_move_to(cr, x_max + 7.0, y - name_height / 2);
+        pango_cairo_show_layout(cr, layout);
+        g_object_unref(layout);
+
+        next_y = y + name_height / 2;
+    }
+}
+
+/*
+ * Draw codes of the rows and columns at every 16th of them.
+ */
+static void draw_plane_labels(cairo_t *cr, uint32_t plane_start)
+{
+    char buf[9];
+    PangoRectangle r;
+
+    cairo_set_line_width(cr, 0.5);
+    for (int i = 0; i < 16; i++) {
+        double pos = i * 16 * overview_cell;
+
+        cairo_move_to(cr, overview_x_min - 3.0, overview_y_min + pos);
+        cairo_line_to(cr, overview_x_min, overview_y_min + pos);
+        cairo_move_to(cr, overview_x_min + pos, overview_y_min - 3.0);
+        cairo_line_to(cr, overview_x_min + pos, overview_y_min);
+    }
+    cairo_stroke(cr);
+
+    for (int i = 0; i < 16; i++) {
+        double pos = i * 16 * overview_cell;
+
+        snprintf(buf, sizeof(buf), "%04lX", (unsigned long)plane_start + i * 0x1000);
+        label_extents(&cell_numbers_label, buf, &r);
+        cairo_move_to(cr, overview_x_min - pango_units_to_double(PANGO_RBEARING(r)) - 5.0,
+                      overview_y_min + pos + pango_units_to_double(PANGO_DESCENT(r)) / 2);
+        show_label(cr, &cell_numbers_label, buf);
+
+        snprintf(buf, sizeof(buf), "%02X", i * 16);
+        label_extents(&cell_numbers_label, buf, &r);
+        cairo_move_to(cr, overview_x_min + pos - pango_units_to_double(r.width) / 2,
+                      overview_y_min - 5.0);
+        show_label(cr, &cell_numbers_label, buf);
+    }
+}
+
+/*
+ * Draw explanation of the square colors below the plane.
+ */
+static void draw_overview_legend(cairo_t *cr, bool comparison)
+{
+    static const enum cell_type types[] = {
+        CELL_GLYPH,   CELL_NEW_GLYPH, CELL_CHANGED_GLYPH, CELL_REMOVED_GLYPH,
+        CELL_MISSING, CELL_UNDEFINED, CELL_CONTROL,
+    };
+    const char *descriptions[CELL_TYPES] = {
+        [CELL_GLYPH] = _("Glyph present in the font"),
+        [CELL_NEW_GLYPH] = _("Glyph missing from the other font"),
+        [CELL_CHANGED_GLYPH] = _("Glyph different in the other font"),
+        [CELL_REMOVED_GLYPH] = _("Glyph present only in the other font"),
+        [CELL_MISSING] = _("Character missing from the font"),
+        [CELL_UNDEFINED] = _("Character not defined in Unicode"),
+        [CELL_CONTROL] = _("Control character"),
+    };
+    double y = overview_y_min + overview_size + 20.0;
+
+    cairo_set_line_width(cr, 0.5);
+    for (unsigned int i = 0; i < G_N_ELEMENTS(types); i++) {
+        enum cell_type type = types[i];
+
+        if (!comparison
+            && (type == CELL_NEW_GLYPH || type == CELL_CHANGED_GLYPH
+                || type == CELL_REMOVED_GLYPH)) {
+            continue;
+        }
+
+        cairo_rectangle(cr, overview_x_min, y, 8.0, 8.0);
+        set_overview_color(cr, type);
+        cairo_fill_preserve(cr);
+        cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+        cairo_stroke(cr);
+
+        PangoRectangle r;
+        PangoLayout *layout = layout_text(cr, table_fonts.overview, descriptions[type], &r);
+        cairo_move_to(cr, overview_x_min + 12.0, y + (8.0 - pango_units_to_double(r.height)) / 2);
+        pango_cairo_show_layout(cr, layout);
+        g_object_unref(layout);
+
+        y += 12.0;
+    }
+}
+
+/*
+ * Draw overview page of the plane. It only depends on the coverage,
+ * no glyphs are drawn.
+ */
+static void draw_overview_page(cairo_t *cr, const struct coverage *cov,
+                               const struct coverage *other_cov, const char *font_name,
+                               int plane, const char *header)
+{
+    uint32_t plane_start = plane * PLANE_SIZE;
+
+    draw_font_name(cr, font_name);
+    draw_block_name(cr, header);
+    draw_plane_squares(cr, cov, other_cov, plane_start);
+
+    cairo_set_line_width(cr, 1.0);
+    cairo_rectangle(cr, overview_x_min, overview_y_min, overview_size, overview_size);
+    cairo_stroke(cr);
+
+    draw_plane_labels(cr, plane_start);
+    draw_plane_blocks(cr, plane_start);
+    draw_overview_legend(cr, other_cov != NULL);
+}
+
+/*
+ * Draw overview pages of the planes from 'planes' bit mask.
+ * Each page is drawn once and copied to all outputs.
+ */
+static void draw_overview(const struct coverage *cov, const struct coverage *other_cov,
+                          const char *font_name, unsigned int planes)
+{
+    const cairo_rectangle_t extents = {0, 0, A4_WIDTH, A4_HEIGHT};
+
+    for (int plane = 0; plane < UNICODE_PLANES; plane++) {
+        if (!(planes & (1u << plane))) {
+            continue;
+        }
+
+        char *header = plane_name(plane);
+        cairo_surface_t *recording
+            = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+        cairo_t *cr = cairo_create(recording);
+
+        cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+        draw_overview_page(cr, cov, other_cov, font_name, plane, header);
+        cairo_destroy(cr);
+
+        for (int i = 0; i < noutputs; i++) {
+            cairo_save(outputs[i].cr);
+            cairo_set_source_surface(outputs[i].cr, recording, 0.0, 0.0);
+            cairo_paint(outputs[i].cr);
+            cairo_restore(outputs[i].cr);
+            cairo_show_page(outputs[i].cr);
+        }
+
+        cairo_surface_destroy(recording);
+        stats_add(STATS_PAGES, 1);
+        progress_advance(1, header);
+        g_free(header);
+    }
+}
+
+/*
+ * Check if any cell of the table differs from the other font.
+ */
+static bool table_has_differences(const struct coverage *cov, const struct coverage *other_cov,
+                                  unsigned long tbl_start, unsigned long tbl_end)
+{
+    for (uint32_t c = tbl_start; c < tbl_end; c++) {
+        enum cell_type type = cell_type(cov, other_cov, c);
+
+        if (type == CELL_NEW_GLYPH || type == CELL_CHANGED_GLYPH || type == CELL_REMOVED_GLYPH) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Find all table pages needed to show characters from the given
+ * Unicode block. Start from character with given charcode (it should
+ * belong to the given Unicode block). Pages are appended to 'pages'.
+ * With --changed-only, pages without differences are left out.
+ *
+ * Returns number of pages found.
+ */
+static int collect_block_pages(const struct coverage *cov, const struct coverage *other_cov,
+                               uint32_t charcode, const struct unicode_block *block,
+                               struct page_list *pages)
+{
+    int npages = 0;
+
+    do {
+        unsigned long offset = ((charcode - block->start) / 0x100) * 0x100;
+        unsigned long tbl_start = block->start + offset;
+        unsigned long tbl_end = tbl_start + 0xFF > block->end ? block->end + 1 : tbl_start + 0x100;
+
+        /* skip the remaining characters of this table */
+        charcode = get_next_char(cov, other_cov, tbl_end);
+
+        if (changed_only && !table_has_differences(cov, other_cov, tbl_start, tbl_end)) {
+            continue;
+        }
+
+        if (pages->n >= pages->nalloc) {
+            int new_nalloc = pages->nalloc + 256;
+            struct table_page *new_pages
+                = realloc(pages->pages, new_nalloc * sizeof(struct table_page));
+            if (new_pages == NULL) {
+                perror("realloc");
+                exit(9);
+            }
+            pages->pages = new_pages;
+            pages->nalloc = new_nalloc;
+        }
+
+        struct table_page *page = pages->pages + pages->n++;
+        page->block = block;
+        page->tbl_start = tbl_start;
+        page->tbl_end = tbl_end;
+        npages++;
+    } while (is_in_block(charcode, block));
+
+    return npages;
+}
+
+/*
+ * Find all table pages needed to show characters from the given coverage.
+ */
+static void collect_pages(const struct coverage *cov, const struct coverage *other_cov,
+                          struct page_list *pages)
+{
+    uint32_t charcode = get_next_char(cov, other_cov, 0);
+
+    while (charcode != COVERAGE_END) {
+        const struct unicode_block *block = get_unicode_block(charcode);
+        if (block) {
+            collect_block_pages(cov, other_cov, charcode, block, pages);
+            charcode = block->end;
+        }
+
+        charcode = get_next_char(cov, other_cov, charcode + 1);
+    }
+}
+
+/*
+ * Emit outlines for Unicode blocks of the pages, the first page has
+ * number 'pageno'.
+ */
+static void outline_blocks(const struct page_list *pages, int pageno)
+{
+    for (int i = 0; i < pages->n; i++) {
+        const struct unicode_block *block = pages->pages[i].block;
+        if (i == 0 || pages->pages[i - 1].block != block) {
+            outline(1, pageno + i, block->name);
+        }
+    }
+}
+
+static PangoLayout *create_glyph_layout(cairo_t *cr, FcConfig *fc_config, FcPattern *fc_font)
+{
+    PangoFontMap *fontmap = pango_cairo_font_map_new_for_font_type(CAIRO_FONT_TYPE_FT);
+    pango_fc_font_map_set_config(PANGO_FC_FONT_MAP(fontmap), fc_config);
+    PangoContext *context = pango_font_map_create_context(fontmap);
+    pango_cairo_update_context(cr, context);
+
+    PangoFontDescription *font_desc = pango_fc_font_description_from_pattern(fc_font, FALSE);
+    PangoLayout *layout = pango_layout_new(context);
+    stats_add(STATS_LAYOUTS, 1);
+    pango_layout_set_font_description(layout, font_desc);
+    pango_layout_set_width(layout, pango_units_from_double(cell_width));
+    pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
+
+    g_object_unref(context);
+    g_object_unref(fontmap);
+    pango_font_description_free(font_desc);
+
+    return layout;
+}
+
+/*
+ * State shared between the threads rendering pages in parallel.
+ */
+struct render_job {
+    const struct page_list *pages;
+    const struct coverage *cov;
+    const struct coverage *other_cov;
+    FcConfig *fc_config;
+    FcPattern *fc_font;
+
+    GMutex lock;
+    GCond cond;
+    int next_page;    /* next page to be rendered by a worker */
+    int next_replay;  /* next page to be replayed to the output */
+    int max_pending;  /* limit on rendered but not yet replayed pages */
+    cairo_surface_t **recordings;
+};
+
+/*
+ * Draw table of a page into a new recording surface, which is then
+ * copied to all outputs. Pages are always drawn this way, with or
+ * without worker threads, so that the output is the same. Glyph layout
+ * is created with the first page and kept in 'layout' for the next ones.
+ */
+static cairo_surface_t *render_page(const struct render_job *job, int i, PangoLayout **layout)
+{
+    const cairo_rectangle_t extents = {0, 0, A4_WIDTH, A4_HEIGHT};
+    cairo_surface_t *recording
+        = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+    cairo_t *cr = cairo_create(recording);
+
+    if (use_pango && !*layout) {
+        *layout = create_glyph_layout(cr, job->fc_config, job->fc_font);
+    }
+
+    cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+    draw_table(cr, *layout, job->cov, job->pages->pages + i, job->other_cov);
+    cairo_destroy(cr);
+
+    return recording;
+}
+
+/*
+ * Worker thread. Takes pages in order and renders them into
+ * recording surfaces. Each worker uses its own Pango context, because
+ * it cannot be shared between threads. Coverage is only read, so it
+ * is shared.
+ */
+static gpointer render_worker(gpointer data)
+{
+    struct render_job *job = data;
+
+    init_font_map();
+
+    PangoLayout *layout = NULL;
+
+    for (;;) {
+        g_mutex_lock(&job->lock);
+        while (job->next_page < job->pages->n
+               && job->next_page >= job->next_replay + job->max_pending) {
+            g_cond_wait(&job->cond, &job->lock);
+        }
+        int i = job->next_page++;
+        g_mutex_unlock(&job->lock);
+
+        if (i >= job->pages->n) {
+            break;
+        }
+
+        cairo_surface_t *recording = render_page(job, i, &layout);
+
+        g_mutex_lock(&job->lock);
+        job->recordings[i] = recording;
+        g_cond_broadcast(&job->cond);
+        g_mutex_unlock(&job->lock);
+    }
+
+    if (layout) {
+        g_object_unref(layout);
+    }
+
+    return NULL;
+}
+
+/*
+ * Render pages using 'jobs' worker threads. Rendered pages are
+ * replayed to the outputs in page order, so the result does
+ * not depend on the number of threads.
+ */
+static void draw_pages_parallel(const struct page_list *pages, const struct coverage *cov,
+                                const struct coverage *other_cov, const char *font_name,
+                                FcConfig *fc_config, FcPattern *fc_font)
+{
+    struct render_job job = {
+        .pages = pages,
+        .cov = cov,
+        .other_cov = other_cov,
+        .fc_config = fc_config,
+        .fc_font = fc_font,
+        .max_pending = 2 * jobs,
+    };
+
+    job.recordings = calloc(pages->n, sizeof(cairo_surface_t *));
+    if (pages->n && !job.recordings) {
+        perror("calloc");
+        exit(9);
+    }
+
+    g_mutex_init(&job.lock);
+    g_cond_init(&job.cond);
+
+    GThread **workers = calloc(jobs, sizeof(GThread *));
+    if (!workers) {
+        perror("calloc");
+        exit(9);
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        workers[i] = g_thread_new("render", render_worker, &job);
+    }
+
+    for (int i = 0; i < pages->n; i++) {
+        g_mutex_lock(&job.lock);
+        while (!job.recordings[i]) {
+            g_cond_wait(&job.cond, &job.lock);
+        }
+        cairo_surface_t *recording = job.recordings[i];
+        job.recordings[i] = NULL;
+        job.next_replay = i + 1;
+        g_cond_broadcast(&job.cond);
+        g_mutex_unlock(&job.lock);
+
+        show_page(recording, font_name, table_columns(pages->pages + i));
+        cairo_surface_destroy(recording);
+        progress_advance(1, pages->pages[i].block->name);
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        g_thread_join(workers[i]);
+    }
+
+    free(workers);
+    g_cond_clear(&job.cond);
+    g_mutex_clear(&job.lock);
+    free(job.recordings);
+}
+
+/* Creation date of PDF output from SOURCE_DATE_EPOCH, empty if it is not set */
+static char pdf_create_date[25];
+
+/*
+ * Read SOURCE_DATE_EPOCH, so fntsample can be used with repeatable builds.
+ * It is read once before drawing starts, as PDF surfaces are also created
+ * by threads writing split output.
+ */
+static void read_source_date(void)
+{
+    char *source_date_epoch = getenv("SOURCE_DATE_EPOCH");
+
+    pdf_create_date[0] = '\0';
+    if (source_date_epoch) {
+        char *endptr;
+        time_t now = strtoul(source_date_epoch, &endptr, 10);
+
+        if (*endptr != 0) {
+            fprintf(stderr, _("Failed to parse environment variable SOURCE_DATE_EPOCH.\n"));
+            exit(1);
+        }
+        struct tm build_time;
+        gmtime_r(&now, &build_time);
+        strftime(pdf_create_date, sizeof(pdf_create_date), "%Y-%m-%dT%H:%M:%SZ", &build_time);
+    }
+}
+
+/*
+ * Configure DPF surface metadata so fntsample can be used with
+ * repeatable builds.
+ */
+static void set_repeatable_pdf_metadata(cairo_surface_t *surface)
+{
+    if (pdf_create_date[0]) {
+        cairo_pdf_surface_set_metadata(surface, CAIRO_PDF_METADATA_CREATE_DATE, pdf_create_date);
+    }
+}
+
+/*
+ * Returns size of the file, or -1 if it cannot be found.
+ */
+static long file_size(const char *file_name)
+{
+    struct stat st;
+
+    return stat(file_name, &st) ? -1 : (long)st.st_size;
+}
+
+/*
+ * Count glyphs shown on the pages.
+ */
+static long count_glyphs(const struct page_list *pages, const struct coverage *cov,
+                         const struct coverage *other_cov)
+{
+    long n = 0;
+
+    for (int i = 0; i < pages->n; i++) {
+        for (uint32_t c = pages->pages[i].tbl_start; c < pages->pages[i].tbl_end; c++) {
+            n += has_glyph(cell_type(cov, other_cov, c));
+        }
+    }
+
+    return n;
+}
+
+/*
+ * A file of split output, holding one or more consecutive pages.
+ */
+struct output_file {
+    int first_page;
+    int npages;
+    char *names[FORMATS]; /* NULL for formats that are not requested */
+    char *cache_key;
+};
+
+/*
+ * State shared between the threads writing split output files.
+ */
+struct split_job {
+    const struct page_list *pages;
+    const struct coverage *cov;
+    const struct coverage *other_cov;
+    const char *font_name;
+    FcConfig *fc_config;
+    FcPattern *fc_font;
+    gint failed; /* set when a file could not be written */
+
+    GMutex chrome_lock;
+    struct page_chrome *free_chrome; /* chrome not used by any thread */
+};
+
+static cairo_surface_t *create_output_surface(const char *file_name, enum output_format format)
+{
+    cairo_surface_t *surface;
+
+    if (format == FORMAT_PS) {
+        surface = cairo_ps_surface_create(file_name, A4_WIDTH, A4_HEIGHT);
+    } else if (format == FORMAT_SVG) {
+        surface = cairo_svg_surface_create(file_name, A4_WIDTH, A4_HEIGHT);
+    } else {
+        surface = cairo_pdf_surface_create(file_name, A4_WIDTH, A4_HEIGHT); /* A4 paper */
+        set_repeatable_pdf_metadata(surface);
+    }
+
+    return surface;
+}
+
+/*
+ * Create output surface that writes to a stream.
+ */
+static cairo_surface_t *create_stream_surface(struct stream_writer *writer,
+                                              enum output_format format)
+{
+    cairo_surface_t *surface;
+
+    if (format == FORMAT_PS) {
+        surface = cairo_ps_surface_create_for_stream(stream_writer_write, writer, A4_WIDTH,
+                                                     A4_HEIGHT);
+    } else if (format == FORMAT_SVG) {
+        surface = cairo_svg_surface_create_for_stream(stream_writer_write, writer, A4_WIDTH,
+                                                      A4_HEIGHT);
+    } else {
+        surface = cairo_pdf_surface_create_for_stream(stream_writer_write, writer, A4_WIDTH,
+                                                      A4_HEIGHT);
+        set_repeatable_pdf_metadata(surface);
+    }
+
+    return surface;
+}
+
+/*
+ * Returns pointer to the extension of the file name, or to its end
+ * if there is none.
+ */
+static const char *file_name_extension(const char *file_name)
+{
+    const char *ext = strrchr(file_name, '.');
+    const char *slash = strrchr(file_name, '/');
+
+    if (!ext || (slash && ext < slash)) {
+        ext = file_name + strlen(file_name);
+    }
+
+    return ext;
+}
+
+/*
+ * Make name of the output file of the given format. When several formats
+ * are requested, extension of the name is replaced by that of the format.
+ * Returned string should be freed using g_free().
+ */
+static char *format_file_name(const char *file_name, enum output_format format)
+{
+    if (nformats == 1) {
+        return g_strdup(file_name);
+    }
+
+    int prefix_len = file_name_extension(file_name) - file_name;
+
+    return g_strdup_printf("%.*s%s", prefix_len, file_name, format_extensions[format]);
+}
+
+/*
+ * Open the main output of the given format. Output is written by
+ * a background thread, either to the descriptor given with -F or -o -,
+ * or to the named file.
+ */
+static struct stream_writer *open_output(enum output_format format)
+{
+    if (output_fd >= 0) {
+        return stream_writer_new(output_fd, false);
+    }
+
+    char *file_name = format_file_name(output_file_name, format);
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror(file_name);
+        exit(1);
+    }
+    g_free(file_name);
+
+    return stream_writer_new(fd, true);
+}
+
+/*
+ * Make name of a split output file from the output file name template.
+ * See check_file_name_template() for the supported sequences. If there are
+ * none, file number is inserted before the extension of the template,
+ * preceded by face index when there are several faces.
+ * Returned string should be freed using g_free().
+ */
+static char *split_file_name(const char *template, int fileno, const struct table_page *first,
+                             const struct table_page *last)
+{
+    if (!strchr(template, '%')) {
+        const char *ext = file_name_extension(template);
+        int prefix_len = ext - template;
+
+        if (split_mode == SPLIT_FACE) {
+            return g_strdup_printf("%.*s-%d%s", prefix_len, template, font_index, ext);
+        } else if (all_faces) {
+            return g_strdup_printf("%.*s-%d-%04d%s", prefix_len, template, font_index, fileno,
+                                   ext);
+        } else {
+            return g_strdup_printf("%.*s-%04d%s", prefix_len, template, fileno, ext);
+        }
+    }
+
+    GString *name = g_string_new(NULL);
+
+    for (const char *p = template; *p; p++) {
+        if (*p != '%') {
+            g_string_append_c(name, *p);
+            continue;
+        }
+
+        switch (*++p) {
+        case 'n':
+            g_string_append_printf(name, "%04d", fileno);
+            break;
+        case 'f':
+            g_string_append_printf(name, "%d", font_index);
+            break;
+        case 'b':
+            for (const char *s = first->block->name; *s; s++) {
+                g_string_append_c(name, g_ascii_isalnum(*s) || *s == '-' ? *s : '_');
+            }
+            break;
+        case 'r':
+            g_string_append_printf(name, "%04lX-%04lX", first->tbl_start, last->tbl_end - 1);
+            break;
+        default:
+            g_string_append_c(name, *p);
+            break;
+        }
+    }
+
+    return g_string_free(name, FALSE);
+}
+
+/*
+ * Group pages into output files according to the split mode.
+ * Returns array of files, its size is stored into 'nfiles'.
+ */
+static struct output_file *collect_output_files(const struct page_list *pages, int *nfiles)
+{
+    struct output_file *files = malloc(pages->n * sizeof(struct output_file));
+    if (pages->n && !files) {
+        perror("malloc");
+        exit(9);
+    }
+
+    int n = 0;
+    for (int i = 0; i < pages->n; i++) {
+        if (split_mode == SPLIT_BLOCK && n > 0
+            && pages->pages[files[n - 1].first_page].block == pages->pages[i].block) {
+            files[n - 1].npages++;
+            continue;
+        }
+
+        files[n].first_page = i;
+        files[n].npages = 1;
+        files[n].cache_key = NULL;
+        n++;
+    }
+
+    for (int format = 0; format < FORMATS; format++) {
+        char *template = has_format(format) ? format_file_name(output_file_name, format) : NULL;
+
+        for (int i = 0; i < n; i++) {
+            const struct table_page *first = pages->pages + files[i].first_page;
+            files[i].names[format]
+                = template ? split_file_name(template, i + 1, first, first + files[i].npages - 1)
+                           : NULL;
+        }
+
+        g_free(template);
+    }
+
+    *nfiles = n;
+    return files;
+}
+
+/*
+ * Write list of output files with their blocks and character ranges.
+ */
+static void write_manifest(const struct page_list *pages, const struct output_file *files,
+                           int nfiles)
+{
+    FILE *f = fopen(manifest_file_name, "w");
+    if (!f) {
+        perror(manifest_file_name);
+        exit(1);
+    }
+
+    for (int i = 0; i < nfiles; i++) {
+        const struct table_page *first = pages->pages + files[i].first_page;
+        const struct table_page *last = first + files[i].npages - 1;
+
+        for (int format = 0; format < FORMATS; format++) {
+            if (files[i].names[format]) {
+                fprintf(f, "%s\t%s\tU+%04lX\tU+%04lX\n", files[i].names[format],
+                        first->block->name, first->tbl_start, last->tbl_end - 1);
+            }
+        }
+    }
+
+    if (fclose(f)) {
+        perror(manifest_file_name);
+        exit(1);
+    }
+}
+
+/*
+ * Add contents of the label font files given with -L to the cache key.
+ */
+static void add_label_fonts_key(GChecksum *checksum)
+{
+    FcFontSet *fonts = label_fc_config ? FcConfigGetFonts(label_fc_config, FcSetApplication) : NULL;
+    const char *last_file = NULL;
+
+    for (int i = 0; fonts && i < fonts->nfont; i++) {
+        const char *file;
+
+        /* Faces of a collection come from the same file */
+        if (FcPatternGetString(fonts->fonts[i], FC_FILE, 0, (FcChar8 **)&file) == FcResultMatch
+            && (!last_file || strcmp(file, last_file))) {
+            page_cache_add_file(checksum, file);
+            last_file = file;
+        }
+    }
+}
+
+/*
+ * Compute cache keys of the output files. A key covers everything that may
+ * change the file: outlines of the glyphs shown on its pages, comparison
+ * font coverage of their ranges, and output parameters. Keys do not depend on
+ * the format, files of each format are cached under their own extension.
+ */
+static void compute_cache_keys(FT_Face face, const struct page_list *pages,
+                               struct output_file *files, int nfiles,
+                               const struct coverage *cov, const struct coverage *other_cov,
+                               const char *font_name)
+{
+    GChecksum *common = g_checksum_new(G_CHECKSUM_SHA256);
+    const char *source_date_epoch = getenv("SOURCE_DATE_EPOCH");
+
+    page_cache_add_string(common, "fntsample page cache 3");
+    page_cache_add_string(common, CMAKE_PROJECT_VERSION);
+    page_cache_add_string(common, cairo_version_string());
+    page_cache_add_string(common, pango_version_string());
+
+    FT_Int ft_version[3];
+    FT_Library_Version(ft_library, ft_version, ft_version + 1, ft_version + 2);
+    page_cache_add(common, ft_version, sizeof(ft_version));
+
+    page_cache_add_string(common, source_date_epoch ? source_date_epoch : "");
+    add_label_fonts_key(common);
+    page_cache_add_string(common, font_name);
+    for (const struct fntsample_style *style = styles; style->name; style++) {
+        page_cache_add_string(common, style->name);
+        page_cache_add_string(common, get_style(style->name));
+    }
+    page_cache_add(common, &resolution, sizeof(resolution));
+    page_cache_add(common, &write_outline, sizeof(write_outline));
+    page_cache_add(common, &use_pango, sizeof(use_pango));
+    page_cache_add(common, &no_embed, sizeof(no_embed));
+    page_cache_add(common, &font_scale, sizeof(font_scale));
+    page_cache_add(common, &glyph_baseline_offset, sizeof(glyph_baseline_offset));
+
+    for (int i = 0; i < nfiles; i++) {
+        GChecksum *checksum = g_checksum_copy(common);
+
+        for (int j = 0; j < files[i].npages; j++) {
+            const struct table_page *page = pages->pages + files[i].first_page + j;
+
+            page_cache_add_string(checksum, page->block->name);
+            page_cache_add(checksum, &page->tbl_start, sizeof(page->tbl_start));
+            page_cache_add(checksum, &page->tbl_end, sizeof(page->tbl_end));
+
+            for (uint32_t c = page->tbl_start; c < page->tbl_end; c++) {
+                enum cell_type type = cell_type(cov, other_cov, c);
+
+                page_cache_add(checksum, &type, sizeof(type));
+                if (has_glyph(type)) {
+                    page_cache_add_glyph(checksum, face, coverage_glyph(cov, c));
+                }
+            }
+        }
+
+        files[i].cache_key = g_strdup(g_checksum_get_string(checksum));
+        g_checksum_free(checksum);
+    }
+
+    g_checksum_free(common);
+}
+
+/*
+ * Create drawing context for a split output file of the given format.
+ */
+static cairo_t *create_file_context(const struct output_file *file, enum output_format format)
+{
+    double scale = resolution / POINTS_PER_INCH;
+    cairo_surface_t *surface;
+
+    if (format == FORMAT_PNG) {
+        surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, ceil(A4_WIDTH * scale),
+                                             ceil(A4_HEIGHT * scale));
+    } else {
+        surface = create_output_surface(file->names[format], format);
+    }
+
+    cairo_t *cr = cairo_create(surface);
+    cairo_surface_destroy(surface);
+
+    if (format == FORMAT_PNG) {
+        cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+        cairo_paint(cr);
+        cairo_scale(cr, scale, scale);
+    }
+    cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+
+    return cr;
+}
+
+/*
+ * Finish a split output file, PNG images are written here.
+ * Returns false if the file could not be written.
+ */
+static bool finish_file(cairo_t *cr, const char *file_name, enum output_format format)
+{
+    cairo_surface_t *surface = cairo_surface_reference(cairo_get_target(cr));
+    cairo_destroy(cr);
+
+    int64_t start = g_get_monotonic_time();
+    cairo_status_t status;
+    if (format == FORMAT_PNG) {
+        status = cairo_surface_write_to_png(surface, file_name);
+    } else {
+        cairo_surface_finish(surface);
+        status = cairo_surface_status(surface);
+    }
+    stats_add(STATS_FINISH_US, g_get_monotonic_time() - start);
+
+    cairo_surface_destroy(surface);
+
+    if (status != CAIRO_STATUS_SUCCESS) {
+        fprintf(stderr, _("Failed to write %s: %s\n"), file_name, cairo_status_to_string(status));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Take page chrome that is not used by other threads of the job.
+ */
+static struct page_chrome *take_page_chrome(struct split_job *job)
+{
+    g_mutex_lock(&job->chrome_lock);
+    struct page_chrome *chrome = job->free_chrome;
+    if (chrome) {
+        job->free_chrome = chrome->next;
+    }
+    g_mutex_unlock(&job->chrome_lock);
+
+    if (!chrome) {
+        chrome = calloc(1, sizeof(struct page_chrome));
+        if (!chrome) {
+            perror("calloc");
+            exit(9);
+        }
+    }
+
+    return chrome;
+}
+
+/*
+ * Return page chrome to the job once all files using it are finished.
+ */
+static void release_page_chrome(struct split_job *job, struct page_chrome *chrome)
+{
+    g_mutex_lock(&job->chrome_lock);
+    chrome->next = job->free_chrome;
+    job->free_chrome = chrome;
+    g_mutex_unlock(&job->chrome_lock);
+}
+
+/*
+ * Render pages of a split output file in each format from 'todo' bit mask.
+ * With one format pages are drawn directly, otherwise each page is drawn
+ * once on a recording surface and copied to all files.
+ * Returns false if any of the files could not be written.
+ */
+static bool draw_split_file(struct split_job *job, const struct output_file *file,
+                            unsigned int todo)
+{
+    const cairo_rectangle_t extents = {0, 0, A4_WIDTH, A4_HEIGHT};
+    enum output_format file_formats[FORMATS];
+    cairo_t *crs[FORMATS];
+    int n = 0;
+    cairo_surface_t *pdf_surface = NULL;
+    int face_outline = CAIRO_PDF_OUTLINE_ROOT;
+
+    for (int format = 0; format < FORMATS; format++) {
+        if (todo & (1 << format)) {
+            file_formats[n] = format;
+            crs[n++] = create_file_context(file, format);
+        }
+    }
+
+    struct page_chrome *chrome = take_page_chrome(job);
+
+    /* PDF is the first of the formats */
+    if (todo & (1 << FORMAT_PDF)) {
+        pdf_surface = cairo_get_target(crs[0]);
+        face_outline = add_pdf_outline(pdf_surface, CAIRO_PDF_OUTLINE_ROOT, 1, job->font_name);
+    }
+
+    PangoLayout *layout = NULL;
+
+    for (int i = 0; i < file->npages; i++) {
+        const struct table_page *page = job->pages->pages + file->first_page + i;
+
+        if (pdf_surface && (i == 0 || page->block != page[-1].block)) {
+            add_pdf_outline(pdf_surface, face_outline, i + 1, page->block->name);
+        }
+
+        cairo_surface_t *recording = NULL;
+        cairo_t *cr = crs[0];
+
+        if (n > 1) {
+            recording = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+            cr = cairo_create(recording);
+            cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+        }
+
+        if (use_pango && !layout) {
+            layout = create_glyph_layout(cr, job->fc_config, job->fc_font);
+        }
+
+        cairo_save(cr);
+        draw_table(cr, layout, job->cov, page, job->other_cov);
+        cairo_restore(cr);
+        draw_page_chrome(cr, chrome, job->font_name, table_columns(page));
+
+        if (recording) {
+            cairo_destroy(cr);
+
+            for (int j = 0; j < n; j++) {
+                cairo_save(crs[j]);
+                cairo_set_source_surface(crs[j], recording, 0.0, 0.0);
+                cairo_paint(crs[j]);
+                cairo_restore(crs[j]);
+            }
+
+            cairo_surface_destroy(recording);
+        }
+
+        /* PNG files have only one page */
+        for (int j = 0; j < n; j++) {
+            if (file_formats[j] != FORMAT_PNG) {
+                cairo_show_page(crs[j]);
+            }
+        }
+    }
+
+    if (layout) {
+        g_object_unref(layout);
+    }
 
-        bool filled_cells[256]; /* 16x16 glyphs max */
-        unsigned long curr_charcode = tbl_start;
-        int pos = 0;
+    bool written = true;
+    for (int j = 0; j < n; j++) {
+        written = finish_file(crs[j], file->names[file_formats[j]], file_formats[j]) && written;
+    }
+    release_page_chrome(job, chrome);
 
-        cairo_save(cr);
-        draw_header(cr, font_name, block->name);
+    return written;
+}
 
-        memset(filled_cells, '\0', sizeof(filled_cells));
+/*
+ * Thread pool function. Writes one output file, or copies it from the cache.
+ * Failures are only recorded in the job, other threads may still be drawing.
+ */
+static void draw_output_file(gpointer data, gpointer user_data)
+{
+    const struct output_file *file = data;
+    struct split_job *job = user_data;
+    const char *block_name = job->pages->pages[file->first_page].block->name;
 
-        /*
-         * Fill empty cells and calculate coordinates of the glyphs.
-         * Also highlight cells if needed.
-         */
-        do {
-            /* fill empty cells before the current glyph */
-            for (; curr_charcode < charcode; curr_charcode++, pos++) {
-                fill_empty_cell(cr, cell_x(x_min, pos), cell_y(pos), curr_charcode);
-            }
+    unsigned int todo = 0;
 
-            /* if it is new glyph - highlight the cell */
-            if (ft_other_face && !FT_Get_Char_Index(ft_other_face, charcode)) {
-                highlight_cell(cr, cell_x(x_min, pos), cell_y(pos));
-            }
+    for (int format = 0; format < FORMATS; format++) {
+        const char *name = file->names[format];
+        const char *ext = format_extensions[format];
 
-            /* draw the character */
-            char buf[9];
-            gint len = g_unichar_to_utf8((gunichar)charcode, buf);
-            pango_layout_set_text(layout, buf, len);
+        if (name && !(file->cache_key && page_cache_fetch(cache_dir, file->cache_key, ext, name))) {
+            todo |= 1 << format;
+        }
+    }
 
-            double baseline = pango_units_to_double(pango_layout_get_baseline(layout));
-            cairo_move_to(cr, cell_x(x_min, pos), cell_y(pos) + glyph_baseline_offset - baseline);
+    if (todo) {
+        init_font_map();
+        if (!draw_split_file(job, file, todo)) {
+            g_atomic_int_set(&job->failed, 1);
+            todo = 0; /* do not cache incomplete files */
+        }
+    }
 
-            if (no_embed) {
-                pango_cairo_layout_path(cr, layout);
-            } else {
-                pango_cairo_show_layout(cr, layout);
-            }
+    for (int format = 0; format < FORMATS && file->cache_key; format++) {
+        if (todo & (1 << format)) {
+            page_cache_store(cache_dir, file->cache_key, format_extensions[format],
+                             file->names[format]);
+        }
+    }
 
-            filled_cells[pos] = true;
-            curr_charcode++;
-            pos++;
+    progress_advance(file->npages, block_name);
+}
 
-            charcode = get_next_char(ft_face, charcode, &idx);
-        } while (idx && (charcode < tbl_end) && is_in_block(charcode, block));
+/*
+ * Write split output using a pool of threads.
+ * Each file is rendered and written independently.
+ */
+static void draw_split_files(const struct page_list *pages, FT_Face face,
+                             const struct coverage *cov, const struct coverage *other_cov,
+                             const char *font_name, FcConfig *fc_config, FcPattern *fc_font)
+{
+    int nfiles;
+    struct output_file *files = collect_output_files(pages, &nfiles);
 
-        /* Fill remaining empty cells */
-        for (; curr_charcode < tbl_end; curr_charcode++, pos++) {
-            fill_empty_cell(cr, cell_x(x_min, pos), cell_y(pos), curr_charcode);
-        }
+    if (manifest_file_name) {
+        write_manifest(pages, files, nfiles);
+    }
 
-        /*
-         * Charcodes are drawn here to avoid switching between the charcode
-         * font and the cell font for each filled cell.
-         */
-        for (unsigned long i = 0; i < tbl_end - tbl_start; i++) {
-            if (filled_cells[i]) {
-                draw_charcode(cr, cell_x(x_min, i), cell_y(i), i + tbl_start);
-            }
+    if (cache_dir) {
+        if (g_mkdir_with_parents(cache_dir, 0777)) {
+            perror(cache_dir);
+            exit(1);
         }
+        compute_cache_keys(face, pages, files, nfiles, cov, other_cov, font_name);
+    }
 
-        draw_grid(cr, rows, tbl_start);
-        npages++;
-        cairo_show_page(cr);
-        cairo_restore(cr);
-    } while (idx && is_in_block(charcode, block));
+    struct split_job job = {
+        .pages = pages,
+        .cov = cov,
+        .other_cov = other_cov,
+        .font_name = font_name,
+        .fc_config = fc_config,
+        .fc_font = fc_font,
+    };
+    g_mutex_init(&job.chrome_lock);
+    int nthreads = jobs > 0 ? jobs : (int)g_get_num_processors();
+
+    GThreadPool *pool = g_thread_pool_new(draw_output_file, &job, nthreads, TRUE, NULL);
+
+    for (int i = 0; i < nfiles; i++) {
+        g_thread_pool_push(pool, files + i, NULL);
+    }
 
-    return npages;
-}
+    g_thread_pool_free(pool, FALSE, TRUE);
 
-static PangoLayout *create_glyph_layout(cairo_t *cr, FcConfig *fc_config, FcPattern *fc_font)
-{
-    PangoFontMap *fontmap = pango_cairo_font_map_new_for_font_type(CAIRO_FONT_TYPE_FT);
-    pango_fc_font_map_set_config(PANGO_FC_FONT_MAP(fontmap), fc_config);
-    PangoContext *context = pango_font_map_create_context(fontmap);
-    pango_cairo_update_context(cr, context);
+    while (job.free_chrome) {
+        struct page_chrome *chrome = job.free_chrome;
+        job.free_chrome = chrome->next;
+        free_page_chrome(chrome);
+        free(chrome);
+    }
+    g_mutex_clear(&job.chrome_lock);
 
-    PangoFontDescription *font_desc = pango_fc_font_description_from_pattern(fc_font, FALSE);
-    PangoLayout *layout = pango_layout_new(context);
-    pango_layout_set_font_description(layout, font_desc);
-    pango_layout_set_width(layout, pango_units_from_double(cell_width));
-    pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
+    if (g_atomic_int_get(&job.failed)) {
+        exit(1);
+    }
 
-    g_object_unref(context);
-    g_object_unref(fontmap);
-    pango_font_description_free(font_desc);
+    if (timing_enabled()) {
+        long bytes = 0;
+        for (int i = 0; i < nfiles; i++) {
+            for (int format = 0; format < FORMATS; format++) {
+                bytes += files[i].names[format] ? file_size(files[i].names[format]) : 0;
+            }
+        }
+        timing_count("output_bytes", bytes);
+    }
 
-    return layout;
+    for (int i = 0; i < nfiles; i++) {
+        for (int format = 0; format < FORMATS; format++) {
+            g_free(files[i].names[format]);
+        }
+        g_free(files[i].cache_key);
+    }
+    free(files);
 }
 
 /*
- * The main drawing function.
+ * The main drawing function. Draws the face starting from page 'pageno'.
+ * Returns number of pages drawn.
  */
-static void draw_glyphs(cairo_t *cr, FT_Face ft_face, FT_Face ft_other_face)
+static int draw_glyphs(FT_Face face, FcPattern *fc_font, const struct coverage *cov,
+                       const struct coverage *other_cov, int pageno)
 {
-    FcConfig *fc_config = FcConfigCreate();
-    FcConfigAppFontAddFile(fc_config, (const FcChar8 *)font_file_name);
-
-    FcPattern *fc_pat = FcPatternCreate();
-    FcPatternAddInteger(fc_pat, FC_INDEX, font_index);
-
-    FcFontSet *fc_fontset = FcFontList(fc_config, fc_pat, NULL);
-    assert(fc_fontset->nfont > 0);
-    FcPattern *fc_font = fc_fontset->fonts[0];
+    /* Pango looks the font up in its own configuration holding only this font */
+    FcConfig *fc_config = NULL;
+    if (use_pango) {
+        fc_config = FcConfigCreate();
+        FcConfigAppFontAddFile(fc_config, (const FcChar8 *)font_file_name);
+    }
 
     const char *font_name;
     if (FcPatternGetString(fc_font, FC_FULLNAME, 0, (FcChar8 **)&font_name) != FcResultMatch) {
         font_name = "Unknown";
     }
 
-    cairo_surface_t *surface = cairo_get_target(cr);
+    /* Overview pages come first, each of them has its own outline */
+    unsigned int planes = overview_mode != OVERVIEW_NONE ? overview_planes(cov, other_cov) : 0;
+    int noverview = 0;
+    for (int plane = 0; plane < UNICODE_PLANES; plane++) {
+        noverview += (planes >> plane) & 1;
+    }
 
-    int pageno = 1;
-    outline(surface, 0, pageno, font_name);
+    struct page_list pages = {NULL, 0, 0};
+    if (overview_mode != OVERVIEW_ONLY) {
+        collect_pages(cov, other_cov, &pages);
+    }
 
-    PangoLayout *layout = create_glyph_layout(cr, fc_config, fc_font);
+    /* Faces without pages, e.g. with --changed-only, get no outline */
+    if (noverview + pages.n > 0) {
+        outline(0, pageno, font_name);
 
-    FT_UInt idx;
-    FT_ULong charcode = get_first_char(ft_face, &idx);
+        int overview_page = pageno;
+        for (int plane = 0; plane < UNICODE_PLANES; plane++) {
+            if (planes & (1u << plane)) {
+                char *header = plane_name(plane);
+                outline(1, overview_page++, header);
+                g_free(header);
+            }
+        }
 
-    while (idx) {
-        const struct unicode_block *block = get_unicode_block(charcode);
-        if (block) {
-            outline(surface, 1, pageno, block->name);
-            int npages = draw_unicode_block(cr, layout, ft_face, font_name, charcode, block,
-                                            ft_other_face);
-            pageno += npages;
-            charcode = block->end;
+        outline_blocks(&pages, pageno + noverview);
+    }
+
+    if (timing_enabled()) {
+        timing_count("pages", pages.n);
+        timing_count("glyphs", count_glyphs(&pages, cov, other_cov));
+    }
+
+    progress_start(font_index, noverview + pages.n);
+
+    struct timing t;
+    timing_start(&t);
+
+    if (noverview) {
+        draw_overview(cov, other_cov, font_name, planes);
+        timing_record(&t, "overview", NULL, noverview);
+        timing_start(&t);
+    }
+
+    if (split_mode != SPLIT_NONE) {
+        draw_split_files(&pages, face, cov, other_cov, font_name, fc_config, fc_font);
+        timing_record(&t, "render", NULL, pages.n);
+    } else if (jobs > 0) {
+        draw_pages_parallel(&pages, cov, other_cov, font_name, fc_config, fc_font);
+        timing_record(&t, "render", NULL, pages.n);
+    } else {
+        const struct render_job job = {
+            .pages = &pages,
+            .cov = cov,
+            .other_cov = other_cov,
+            .fc_config = fc_config,
+            .fc_font = fc_font,
+        };
+        PangoLayout *layout = NULL;
+        int block_first = 0;
+
+        for (int i = 0; i < pages.n; i++) {
+            const struct table_page *page = pages.pages + i;
+
+            /* Drawn the same way as by worker threads, see render_page() */
+            cairo_surface_t *recording = render_page(&job, i, &layout);
+            show_page(recording, font_name, table_columns(page));
+            cairo_surface_destroy(recording);
+            progress_advance(1, page->block->name);
+
+            /* Blocks are timed separately when pages are drawn in order */
+            if (i + 1 == pages.n || page[1].block != page->block) {
+                timing_record(&t, "block", page->block->name, i + 1 - block_first);
+                timing_start(&t);
+                block_first = i + 1;
+            }
         }
 
-        charcode = get_next_char(ft_face, charcode, &idx);
+        if (layout) {
+            g_object_unref(layout);
+        }
     }
 
-    g_object_unref(layout);
+    int npages = noverview + pages.n;
+    free(pages.pages);
+    free_page_chrome(&page_chrome);
+
+    if (fc_config) {
+        FcConfigDestroy(fc_config);
+    }
 
-    FcPatternDestroy(fc_pat);
-    FcFontSetDestroy(fc_fontset);
-    FcConfigDestroy(fc_config);
+    return npages;
 }
 
 /*
@@ -756,29 +2940,58 @@ static void usage(const char *cmd)
 {
     fprintf(stderr,
             _("Usage: %s [ OPTIONS ] -f FONT-FILE -o OUTPUT-FILE\n"
+              "       %s [ OPTIONS ] --serve SOCKET\n"
               "       %s -h\n\n"),
-            cmd, cmd);
+            cmd, cmd, cmd);
     fprintf(
         stderr,
         _("Options:\n"
           "  --blocks-file,       -b BLOCKS-FILE  Read Unicode blocks information from "
           "BLOCKS-FILE\n"
+          "  --blocks-cache,      -B FILE         Cache parsed BLOCKS-FILE in FILE\n"
           "  --font-file,         -f FONT-FILE    Create samples of FONT-FILE\n"
           "  --font-index,        -n IDX          Font index in FONT-FILE\n"
-          "  --output-file,       -o OUTPUT-FILE  Save samples to OUTPUT-FILE\n"
+          "  --all-faces,         -A              Draw all fonts in FONT-FILE\n"
+          "  --output-file,       -o OUTPUT-FILE  Save samples to OUTPUT-FILE, - for standard "
+          "output\n"
+          "  --output-fd,         -F FD           Write samples to file descriptor FD\n"
           "  --help,              -h              Show this information message and exit\n"
           "  --other-font-file,   -d OTHER-FONT   Compare FONT-FILE with OTHER-FONT and highlight "
           "added glyphs\n"
           "  --other-index,       -m IDX          Font index in OTHER-FONT\n"
+          "  --changed-only,      -D              Only show pages that differ from OTHER-FONT\n"
+          "  --overview,          -H MODE         Draw overview of Unicode planes, MODE is first "
+          "or only\n"
           "  --postscript-output, -s              Use PostScript format for output instead of PDF\n"
           "  --svg,               -g              Use SVG format for output\n"
+          "  --png,               -r              Use PNG format for output, one file per page\n"
+          "  --formats,           -O LIST         Write output in each of comma separated formats "
+          "pdf, ps, svg and png\n"
+          "  --resolution,        -R DPI          Resolution of PNG output (default: 150)\n"
+          "  --split,             -S MODE         Write each block, page or font to its own file, "
+          "MODE is block, page or face\n"
+          "  --manifest,          -M FILE         Write list of split output files to FILE\n"
+          "  --timings,           -T FILE         Append timings of drawing phases to FILE\n"
+          "  --stats,             -u FILE         Write drawing statistics to FILE in JSON format\n"
+          "  --progress,          -P FD           Write progress of drawing to file descriptor FD\n"
+          "  --coverage-report,   -c FORMAT       Write report of supported characters in FORMAT, "
+          "json or csv\n"
+          "  --cache-dir,         -C DIR          Reuse unchanged split output files cached in "
+          "DIR\n"
           "  --print-outline,     -l              Print document outlines data to standard output\n"
           "  --write-outline,     -w              Write document outlines (only in PDF output)\n"
           "  --no-embed,          -e              Don't embed the font in the output file, draw "
           "the glyphs instead\n"
+          "  --use-pango,         -p              Use Pango to shape and draw the glyphs\n"
           "  --include-range,     -i RANGE        Show characters in RANGE\n"
           "  --exclude-range,     -x RANGE        Do not show characters in RANGE\n"
-          "  --style,             -t \"STYLE: VAL\" Set STYLE to value VAL\n"));
+          "  --style,             -t \"STYLE: VAL\" Set STYLE to value VAL\n"
+          "  --label-font-file,   -L FILE         Use fonts from FILE for styles instead of system "
+          "fonts\n"
+          "  --jobs,              -j N            Render pages using N threads (0 for number of "
+          "processors)\n"
+          "  --serve,             -k SOCKET       Draw samples requested by clients connecting to "
+          "SOCKET\n"));
 
     fprintf(stderr, _("\nSupported styles (and default values):\n"));
 
@@ -792,26 +3005,32 @@ static void usage(const char *cmd)
  */
 static void init_table_fonts(void)
 {
-    /* FIXME is this correct? */
-    PangoCairoFontMap *map = (PangoCairoFontMap *)pango_cairo_font_map_get_default();
-
-    pango_cairo_font_map_set_resolution(map, POINTS_PER_INCH);
+    init_font_map();
 
     table_fonts.header = pango_font_description_from_string(get_style("header-font"));
     table_fonts.font_name = pango_font_description_from_string(get_style("font-name-font"));
     table_fonts.table_numbers = pango_font_description_from_string(get_style("table-numbers-font"));
     table_fonts.cell_numbers = pango_font_description_from_string(get_style("cell-numbers-font"));
+    table_fonts.overview = pango_font_description_from_string(get_style("overview-font"));
+}
+
+/*
+ * Shape digits used in table and cell labels.
+ */
+static void init_label_fonts(cairo_t *cr)
+{
+    init_label_font(cr, table_fonts.table_numbers, &table_numbers_label);
+    init_label_font(cr, table_fonts.cell_numbers, &cell_numbers_label);
 }
 
 /*
  * Calculate various offsets.
  */
-static void calculate_offsets(cairo_t *cr)
+static void calculate_offsets(void)
 {
     PangoRectangle extents;
     /* Assume that vertical extents does not depend on actual text */
-    PangoLayout *l = layout_text(cr, table_fonts.cell_numbers, "0123456789ABCDEF", &extents);
-    g_object_unref(l);
+    label_extents(&cell_numbers_label, hexdigs, &extents);
     /* Unsolved mistery of pango's font metrics.... */
     double digits_ascent = pango_units_to_double(PANGO_DESCENT(extents));
     double digits_descent = -pango_units_to_double(PANGO_ASCENT(extents));
@@ -867,84 +3086,247 @@ void calc_font_scaling(FT_Face ft_face)
     cairo_scaled_font_extents(cr_font, &extents);
     glyph_baseline_offset
         = (tgt_size - (extents.ascent + extents.descent)) / 2 + 2 + extents.ascent;
-    cairo_scaled_font_destroy(cr_font);
+
+    /* Keep the scaled font for drawing glyphs without Pango */
+    glyph_font = cr_font;
+    if (no_embed) {
+        glyph_paths = glyph_paths_new(glyph_font, font_scale);
+    }
+
+    cairo_font_options_destroy(options);
+    cairo_font_face_destroy(cr_face);
 }
 
 /*
- * Configure DPF surface metadata so fntsample can be used with
- * repeatable builds.
+ * Write coverage report for characters in the selected ranges.
  */
-static void set_repeatable_pdf_metadata(cairo_surface_t *surface)
+static void write_report(const struct coverage *cov, const struct coverage *other_cov)
 {
-    char *source_date_epoch = getenv("SOURCE_DATE_EPOCH");
+    uint64_t *mask = calloc(COVERAGE_WORDS, sizeof(uint64_t));
+    if (!mask) {
+        perror("calloc");
+        exit(9);
+    }
 
-    if (source_date_epoch) {
-        char *endptr;
-        time_t now = strtoul(source_date_epoch, &endptr, 10);
+    ranges_mask(mask);
 
-        if (*endptr != 0) {
-            fprintf(stderr, _("Failed to parse environment variable SOURCE_DATE_EPOCH.\n"));
-            exit(1);
+    const char *name = output_fd >= 0 ? "output" : output_file_name;
+    FILE *f = output_fd >= 0 ? fdopen(dup(output_fd), "w") : fopen(output_file_name, "w");
+    if (!f) {
+        perror(name);
+        exit(1);
+    }
+
+    write_coverage_report(f, report_format, unicode_blocks, nunicode_blocks, mask, cov, other_cov);
+
+    if (fclose(f)) {
+        perror(name);
+        exit(1);
+    }
+
+    free(mask);
+}
+
+/*
+ * Create a face from a font file mapped into memory.
+ * The mapping should be kept until the face is released.
+ */
+static FT_Error new_mapped_face(FT_Library library, GMappedFile *data, int index, FT_Face *face)
+{
+    return FT_New_Memory_Face(library, (const FT_Byte *)g_mapped_file_get_contents(data),
+                              g_mapped_file_get_length(data), index, face);
+}
+
+/*
+ * Open the face to sample with index 'font_index' and build coverage of
+ * it and of the face to compare with. With --all-faces each face is
+ * compared with the face of the same index, unless -m is given.
+ */
+static FT_Face open_faces(const char *prog, FT_Library library, GMappedFile *font_data,
+                          struct coverage **cov, struct coverage **other_cov)
+{
+    FT_Face face;
+
+    if (new_mapped_face(library, font_data, font_index, &face)) {
+        fprintf(stderr, _("%s: failed to open font file %s\n"), prog, font_file_name);
+        exit(4);
+    }
+
+    *cov = coverage_new(face);
+    *other_cov = NULL;
+
+    if (other_font_file_name) {
+        FT_Face other_face;
+        GMappedFile *other_data = strcmp(other_font_file_name, font_file_name)
+            ? g_mapped_file_new(other_font_file_name, FALSE, NULL)
+            : g_mapped_file_ref(font_data);
+        int index = other_index_given || !all_faces ? other_index : font_index;
+
+        if (!other_data || new_mapped_face(library, other_data, index, &other_face)) {
+            fprintf(stderr, _("%s: failed to create new font face\n"), prog);
+            exit(4);
         }
-        struct tm *build_time = gmtime(&now);
-        char buffer[25];
-        strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", build_time);
 
-        cairo_pdf_surface_set_metadata(surface, CAIRO_PDF_METADATA_CREATE_DATE, buffer);
+        *other_cov = coverage_new(other_face);
+        if (report_format == REPORT_NONE) {
+            changed_glyphs = glyph_diff_new(face, *cov, other_face, *other_cov);
+        }
+        FT_Done_Face(other_face);
+        g_mapped_file_unref(other_data);
     }
+
+    return face;
 }
 
-int main(int argc, char **argv)
+/*
+ * Draw the face with index 'font_index' starting from page 'pageno'.
+ * Returns number of pages drawn.
+ */
+static int draw_face(const char *prog, FT_Library library, GMappedFile *font_data, int pageno)
 {
-    setlocale(LC_ALL, "");
-    bindtextdomain(CMAKE_PROJECT_NAME, CMAKE_INSTALL_FULL_LOCALEDIR);
-    textdomain(CMAKE_PROJECT_NAME);
+    struct coverage *cov;
+    struct coverage *other_cov;
+    struct timing t;
+
+    timing_set_face(font_index);
+    timing_start(&t);
+    FT_Face face = open_faces(prog, library, font_data, &cov, &other_cov);
+    timing_record(&t, "open", NULL, cov->nchars);
+
+    /* Query the pattern before cairo starts changing the face size */
+    timing_start(&t);
+    FcPattern *fc_font
+        = FcFreeTypeQueryFace(face, (const FcChar8 *)font_file_name, font_index, NULL);
+    if (!fc_font) {
+        fc_font = FcPatternCreate();
+    }
+    timing_record(&t, "fontconfig", NULL, -1);
 
-    parse_options(argc, argv);
+    timing_start(&t);
+    calc_font_scaling(face);
+    timing_record(&t, "scaling", NULL, -1);
 
-    FT_Library library;
-    FT_Error error = FT_Init_FreeType(&library);
+    int npages = draw_glyphs(face, fc_font, cov, other_cov, pageno);
+    if (glyph_paths) {
+        glyph_paths_free(glyph_paths);
+        glyph_paths = NULL;
+    }
+    cairo_scaled_font_destroy(glyph_font);
 
-    if (error) {
-        /* TRANSLATORS: 'freetype' is a name of a library, and should be left untranslated */
-        fprintf(stderr, _("%s: freetype error\n"), argv[0]);
-        exit(3);
+    /* The face itself is kept, the output surface may still refer to it */
+    coverage_free(other_cov);
+    coverage_free(cov);
+    free(changed_glyphs);
+    changed_glyphs = NULL;
+    FcPatternDestroy(fc_font);
+
+    return npages;
+}
+
+/*
+ * Write statistics collected since 'start' if requested.
+ */
+static void write_stats(const struct timing *start)
+{
+    if (stats_file_name) {
+        int64_t wall;
+        long cpu;
+        timing_elapsed(start, &wall, &cpu);
+        stats_write(stats_file_name, font_file_name, wall, cpu);
     }
+}
 
+static int count_faces(const char *prog, FT_Library library, GMappedFile *font_data)
+{
     FT_Face face;
-    error = FT_New_Face(library, font_file_name, font_index, &face);
 
-    if (error) {
-        fprintf(stderr, _("%s: failed to open font file %s\n"), argv[0], font_file_name);
+    if (new_mapped_face(library, font_data, -1, &face)) {
+        fprintf(stderr, _("%s: failed to open font file %s\n"), prog, font_file_name);
         exit(4);
     }
 
-    FT_Face other_face = NULL;
+    int nfaces = face->num_faces;
+    FT_Done_Face(face);
 
-    if (other_font_file_name) {
-        error = FT_New_Face(library, other_font_file_name, other_index, &other_face);
+    return nfaces;
+}
 
-        if (error) {
-            fprintf(stderr, _("%s: failed to create new font face\n"), argv[0]);
-            exit(4);
+/* Wait for a child process. Returns true if it failed. */
+static bool wait_child(void)
+{
+    int status;
+
+    if (wait(&status) < 0) {
+        perror("wait");
+        exit(1);
+    }
+
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+/*
+ * Draw faces into separate files in child processes, at most as many at
+ * once as there are jobs. All children share the font file mapping.
+ * Returns in the child with 'font_index' set to its face, the parent exits
+ * when all children are done.
+ */
+static void fork_faces(int nfaces)
+{
+    int max_children = jobs > 0 ? jobs : (int)g_get_num_processors();
+    int running = 0;
+    bool failed = false;
+
+    for (int i = 0; i < nfaces; i++) {
+        if (running == max_children) {
+            failed |= wait_child();
+            running--;
+        }
+
+        /* Buffered output of the parent should not be written by children */
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        } else if (pid == 0) {
+            font_index = i;
+            return;
         }
+        running++;
     }
 
-    cairo_surface_t *surface;
+    while (running--) {
+        failed |= wait_child();
+    }
 
-    if (postscript_output) {
-        surface = cairo_ps_surface_create(output_file_name, A4_WIDTH, A4_HEIGHT);
-    } else if (svg_output) {
-        surface = cairo_svg_surface_create(output_file_name, A4_WIDTH, A4_HEIGHT);
-    } else {
-        surface = cairo_pdf_surface_create(output_file_name, A4_WIDTH, A4_HEIGHT); /* A4 paper */
-        set_repeatable_pdf_metadata(surface);
+    exit(failed ? 1 : 0);
+}
+
+/*
+ * Initialize FreeType library, it is shared by all jobs of the server.
+ */
+static void init_freetype(const char *prog)
+{
+    if (ft_library) {
+        return;
+    }
+
+    if (FT_Init_FreeType(&ft_library)) {
+        /* TRANSLATORS: 'freetype' is a name of a library, and should be left untranslated */
+        fprintf(stderr, _("%s: freetype error\n"), prog);
+        exit(3);
     }
+}
 
+/*
+ * Create drawing context for the surface. The surface is released.
+ */
+static cairo_t *create_context(const char *prog, cairo_surface_t *surface)
+{
     cairo_status_t cr_status = cairo_surface_status(surface);
     if (cr_status != CAIRO_STATUS_SUCCESS) {
         /* TRANSLATORS: 'cairo' is a name of a library, and should be left untranslated */
-        fprintf(stderr, _("%s: failed to create cairo surface: %s\n"), argv[0],
+        fprintf(stderr, _("%s: failed to create cairo surface: %s\n"), prog,
                 cairo_status_to_string(cr_status));
         exit(1);
     }
@@ -952,20 +3334,188 @@ int main(int argc, char **argv)
     cairo_t *cr = cairo_create(surface);
     cr_status = cairo_status(cr);
     if (cr_status != CAIRO_STATUS_SUCCESS) {
-        fprintf(stderr, _("%s: cairo_create failed: %s\n"), argv[0],
+        fprintf(stderr, _("%s: cairo_create failed: %s\n"), prog,
                 cairo_status_to_string(cr_status));
         exit(1);
     }
 
     cairo_surface_destroy(surface);
 
+    return cr;
+}
+
+/*
+ * Draw the samples as requested by the options. Timings of the whole run
+ * are measured from 'start'. Returns exit status.
+ */
+static int run(const char *prog, const struct timing *start)
+{
+    struct timing total = *start, t = *start;
+
+    if (timings_file_name) {
+        timing_open(timings_file_name, font_file_name);
+    }
+    timing_record(&t, "options", NULL, -1);
+
+    read_source_date();
+    init_freetype(prog);
+
+    GMappedFile *font_data = g_mapped_file_new(font_file_name, FALSE, NULL);
+
+    if (!font_data) {
+        fprintf(stderr, _("%s: failed to open font file %s\n"), prog, font_file_name);
+        exit(4);
+    }
+
+    if (report_format != REPORT_NONE) {
+        struct coverage *cov;
+        struct coverage *other_cov;
+        open_faces(prog, ft_library, font_data, &cov, &other_cov);
+        write_report(cov, other_cov);
+        coverage_free(other_cov);
+        coverage_free(cov);
+        write_stats(&total);
+        return 0;
+    }
+
+    int first_face = font_index;
+    int last_face = font_index;
+
+    if (all_faces) {
+        int nfaces = count_faces(prog, ft_library, font_data);
+
+        if (split_mode != SPLIT_NONE) {
+            fork_faces(nfaces);
+            first_face = last_face = font_index;
+        } else {
+            first_face = 0;
+            last_face = nfaces - 1;
+        }
+    }
+
+    if (split_mode == SPLIT_FACE) {
+        output_file_name = split_file_name(output_file_name, 0, NULL, NULL);
+        split_mode = SPLIT_NONE;
+    }
+
+    cairo_t *cr;
+
+    if (split_mode != SPLIT_NONE) {
+        /* Pages are drawn on separate surfaces, this one is only used for measuring */
+        const cairo_rectangle_t extents = {0, 0, A4_WIDTH, A4_HEIGHT};
+        cr = create_context(prog,
+                            cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents));
+    } else {
+        /* Outputs are drawn in the order of formats, PDF first */
+        for (int format = 0; format < FORMATS; format++) {
+            if (has_format(format)) {
+                struct output *output = outputs + noutputs++;
+                output->format = format;
+                output->writer = open_output(format);
+                output->cr = create_context(prog, create_stream_surface(output->writer, format));
+            }
+        }
+        cr = outputs[0].cr;
+    }
+
     init_table_fonts();
-    calculate_offsets(cr);
+    init_label_fonts(cr);
+    calculate_offsets();
 
     cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
-    calc_font_scaling(face);
-    draw_glyphs(cr, face, other_face);
-    cairo_destroy(cr);
+
+    int pageno = 1;
+    for (font_index = first_face; font_index <= last_face; font_index++) {
+        pageno += draw_face(prog, ft_library, font_data, pageno);
+    }
+
+    /*
+     * Output surfaces are finished when the last reference is released,
+     * then the writers wait until all output is written.
+     */
+    timing_start(&t);
+    if (!noutputs) {
+        cairo_destroy(cr);
+    }
+
+    int64_t output_bytes = 0;
+    int write_error = 0;
+    for (int i = 0; i < noutputs; i++) {
+        cairo_destroy(outputs[i].cr);
+        output_bytes += stream_writer_bytes(outputs[i].writer);
+        int error = stream_writer_close(outputs[i].writer);
+        write_error = write_error ? write_error : error;
+    }
+    timing_record(&t, "finish", NULL, -1);
+
+    if (write_error) {
+        fprintf(stderr, _("%s: failed to write output: %s\n"), prog, g_strerror(write_error));
+        exit(1);
+    }
+
+    if (noutputs) {
+        stats_add(STATS_FINISH_US, g_get_monotonic_time() - t.wall);
+        timing_count("output_bytes", output_bytes);
+    }
+    timing_record(&total, "total", NULL, -1);
+    timing_close();
+    write_stats(&total);
 
     return 0;
 }
+
+/*
+ * Run a job received by the server in its own process.
+ * Options of the job are added to the options of the server.
+ */
+static int render_job(int argc, char **argv, int fd)
+{
+    struct timing start;
+    timing_start(&start);
+
+    serve_socket_name = NULL;
+    jobs = 0;
+    output_fd = fd;
+    in_job = true;
+    optind = 1;
+    parse_options(argc, argv);
+
+    if (output_fd != fd) {
+        fprintf(stderr, _("Output of a job is always sent to the client!\n"));
+        return 1;
+    }
+
+    return run(argv[0], &start);
+}
+
+/*
+ * Prepare what does not depend on the font before the server starts
+ * accepting jobs. Jobs run in forked processes, and Pango font maps may
+ * start threads that do not survive fork(), so only FreeType is set up
+ * here and fonts of the labels are loaded by each job. Unicode blocks
+ * are already loaded with the options.
+ */
+static void warm_up(const char *prog)
+{
+    init_freetype(prog);
+}
+
+int main(int argc, char **argv)
+{
+    setlocale(LC_ALL, "");
+    bindtextdomain(CMAKE_PROJECT_NAME, CMAKE_INSTALL_FULL_LOCALEDIR);
+    textdomain(CMAKE_PROJECT_NAME);
+
+    struct timing start;
+    timing_start(&start);
+
+    parse_options(argc, argv);
+
+    if (serve_socket_name) {
+        int max_jobs = jobs > 0 ? jobs : (int)g_get_num_processors();
+        warm_up(argv[0]);
+        serve(argv[0], serve_socket_name, max_jobs, render_job);
+    }
+
+    return run(argv[0], &start);
+}
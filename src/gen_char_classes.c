@@ -0,0 +1,152 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "char_classes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NCHARS (CHAR_CLASS_PAGES * 256)
+
+/*
+ * Class of a character with the given general category.
+ */
+static enum char_class category_class(const char *category)
+{
+    if (!strcmp(category, "Cn") || !strcmp(category, "Cs")) {
+        return CHAR_UNDEFINED;
+    } else if (!strcmp(category, "Cc")) {
+        return CHAR_CONTROL;
+    }
+
+    return CHAR_ASSIGNED;
+}
+
+/*
+ * Read classes of all characters from DerivedGeneralCategory.txt.
+ * Characters not listed in the file are unassigned.
+ *
+ * Returns -1 if the file cannot be read or has no categories.
+ */
+static int read_classes(const char *file_name, uint8_t *classes)
+{
+    FILE *input_file = fopen(file_name, "r");
+    if (!input_file) {
+        perror("fopen");
+        return -1;
+    }
+
+    memset(classes, CHAR_UNDEFINED, NCHARS);
+
+    char *line = NULL;
+    size_t len = 0;
+    int nranges = 0;
+
+    while (getline(&line, &len, input_file) != -1) {
+        unsigned long first, last;
+        char category[3];
+
+        /* Lines have either a single character or a range */
+        if (sscanf(line, "%lx..%lx ; %2s", &first, &last, category) != 3) {
+            if (sscanf(line, "%lx ; %2s", &first, category) != 2) {
+                continue;
+            }
+            last = first;
+        }
+
+        if (first > last || last >= NCHARS) {
+            fprintf(stderr, "Invalid character range %04lX..%04lX.\n", first, last);
+            free(line);
+            fclose(input_file);
+            return -1;
+        }
+
+        memset(classes + first, category_class(category), last - first + 1);
+        nranges++;
+    }
+
+    free(line);
+    fclose(input_file);
+
+    return nranges ? 0 : -1;
+}
+
+/*
+ * Write the two stage table described in char_classes.h.
+ */
+static void write_table(FILE *f, const uint8_t *classes)
+{
+    static uint8_t rows[CHAR_CLASS_PAGES][CHAR_CLASS_ROW_SIZE];
+    static uint16_t pages[CHAR_CLASS_PAGES];
+    int nrows = 0;
+
+    for (int page = 0; page < CHAR_CLASS_PAGES; page++) {
+        uint8_t row[CHAR_CLASS_ROW_SIZE] = {0};
+
+        for (int i = 0; i < 256; i++) {
+            row[i / 4] |= classes[page * 256 + i] << (i % 4 * 2);
+        }
+
+        int r;
+        for (r = 0; r < nrows; r++) {
+            if (!memcmp(rows[r], row, sizeof(row))) {
+                break;
+            }
+        }
+
+        if (r == nrows) {
+            memcpy(rows[nrows++], row, sizeof(row));
+        }
+
+        pages[page] = r;
+    }
+
+    fprintf(f, "#include \"char_classes.h\"\n");
+
+    fprintf(f, "\nconst uint16_t static_char_class_pages[CHAR_CLASS_PAGES] = {\n");
+    for (int page = 0; page < CHAR_CLASS_PAGES; page++) {
+        fprintf(f, "%s%d,%s", page % 16 ? " " : "    ", pages[page], page % 16 == 15 ? "\n" : "");
+    }
+    fprintf(f, "};\n");
+
+    fprintf(f, "\nconst uint8_t static_char_class_rows[][CHAR_CLASS_ROW_SIZE] = {\n");
+    for (int r = 0; r < nrows; r++) {
+        fprintf(f, "    {");
+        for (int i = 0; i < CHAR_CLASS_ROW_SIZE; i++) {
+            fprintf(f, "%s%s0x%02x", i ? "," : "", i % 16 ? " " : "\n        ", rows[r][i]);
+        }
+        fprintf(f, "\n    },\n");
+    }
+    fprintf(f, "};\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s DerivedGeneralCategory.txt output.c\n", argv[0]);
+        return 1;
+    }
+
+    uint8_t *classes = malloc(NCHARS);
+    if (!classes) {
+        perror("malloc");
+        return 3;
+    }
+
+    if (read_classes(argv[1], classes)) {
+        fprintf(stderr, "Failed to read general categories file.\n");
+        return 2;
+    }
+
+    FILE *f = fopen(argv[2], "wb");
+    if (!f) {
+        perror("fopen");
+        return 3;
+    }
+
+    write_table(f, classes);
+    free(classes);
+    fclose(f);
+
+    return 0;
+}
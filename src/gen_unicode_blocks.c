@@ -2,7 +2,9 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 #include "unicode_blocks.h"
+#include "static_unicode_blocks.h"
 #include <stdio.h>
+#include <string.h>
 
 static void write_header(FILE *f)
 {
@@ -33,6 +35,32 @@ static void write_blocks(FILE *f, const struct unicode_block *blocks, int n)
     write_footer(f);
 }
 
+/*
+ * Write lookup table that maps characters to blocks.
+ */
+static void write_lookup_table(FILE *f, const struct unicode_block *blocks, int n)
+{
+    static uint16_t rows[BLOCK_LOOKUP_PAGES + 1][16];
+    static uint16_t pages[BLOCK_LOOKUP_PAGES];
+    int nrows = build_block_lookup(blocks, n, pages, rows);
+
+    fprintf(f, "\nconst uint16_t static_unicode_block_pages[BLOCK_LOOKUP_PAGES] = {\n");
+    for (int page = 0; page < BLOCK_LOOKUP_PAGES; page++) {
+        fprintf(f, "%s%d,%s", page % 16 ? " " : "    ", pages[page], page % 16 == 15 ? "\n" : "");
+    }
+    fprintf(f, "};\n");
+
+    fprintf(f, "\nconst uint16_t static_unicode_block_rows[][16] = {\n");
+    for (int r = 0; r < nrows; r++) {
+        fprintf(f, "    {");
+        for (int i = 0; i < 16; i++) {
+            fprintf(f, "%s%d", i ? ", " : "", rows[r][i]);
+        }
+        fprintf(f, "},\n");
+    }
+    fprintf(f, "};\n");
+}
+
 int main(int argc, char **argv)
 {
     if (argc != 3) {
@@ -48,6 +76,16 @@ int main(int argc, char **argv)
         return 2;
     }
 
+    if (sort_blocks(blocks, n)) {
+        fprintf(stderr, "Unicode blocks overlap or have invalid ranges.\n");
+        return 2;
+    }
+
+    if (!blocks_aligned(blocks, n)) {
+        fprintf(stderr, "Blocks are not aligned to 16 characters or are out of range.\n");
+        return 2;
+    }
+
     FILE *f = fopen(argv[2], "wb");
     if (!f) {
         perror("fopen");
@@ -55,6 +93,7 @@ int main(int argc, char **argv)
     }
 
     write_blocks(f, blocks, n);
+    write_lookup_table(f, blocks, n);
     free(blocks);
     fclose(f);
 
@@ -0,0 +1,178 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "glyph_diff.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <freetype/ftoutln.h>
+
+/* 64-bit FNV-1a */
+#define HASH_INIT UINT64_C(0xcbf29ce484222325)
+#define HASH_PRIME UINT64_C(0x100000001b3)
+
+static void hash_bytes(uint64_t *hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        *hash = (*hash ^ p[i]) * HASH_PRIME;
+    }
+}
+
+static void hash_point(uint64_t *hash, char op, const FT_Vector *point)
+{
+    hash_bytes(hash, &op, 1);
+    hash_bytes(hash, &point->x, sizeof(point->x));
+    hash_bytes(hash, &point->y, sizeof(point->y));
+}
+
+static int hash_move_to(const FT_Vector *to, void *user)
+{
+    hash_point(user, 'M', to);
+    return 0;
+}
+
+static int hash_line_to(const FT_Vector *to, void *user)
+{
+    hash_point(user, 'L', to);
+    return 0;
+}
+
+static int hash_conic_to(const FT_Vector *control, const FT_Vector *to, void *user)
+{
+    hash_point(user, 'Q', control);
+    hash_point(user, 'Q', to);
+    return 0;
+}
+
+static int hash_cubic_to(const FT_Vector *control1, const FT_Vector *control2,
+                         const FT_Vector *to, void *user)
+{
+    hash_point(user, 'C', control1);
+    hash_point(user, 'C', control2);
+    hash_point(user, 'C', to);
+    return 0;
+}
+
+static const FT_Outline_Funcs hash_funcs = {
+    hash_move_to, hash_line_to, hash_conic_to, hash_cubic_to, 0, 0,
+};
+
+/*
+ * Compute hash of the glyph shape and advance in font units.
+ * Outlines are hashed as a sequence of drawing operations, so glyphs
+ * that look the same have the same hash even if their point tags differ.
+ */
+uint64_t glyph_outline_hash(FT_Face face, FT_UInt glyph)
+{
+    uint64_t hash = HASH_INIT;
+
+    FT_Error error = FT_Load_Glyph(face, glyph, FT_LOAD_NO_SCALE);
+    if (error) {
+        /* Bitmap only fonts cannot be loaded unscaled */
+        error = FT_Load_Glyph(face, glyph, FT_LOAD_DEFAULT);
+    }
+
+    hash_bytes(&hash, &error, sizeof(error));
+    if (error) {
+        return hash;
+    }
+
+    FT_GlyphSlot slot = face->glyph;
+    hash_bytes(&hash, &slot->metrics.horiAdvance, sizeof(slot->metrics.horiAdvance));
+
+    if (slot->format == FT_GLYPH_FORMAT_OUTLINE) {
+        FT_Outline_Decompose(&slot->outline, &hash_funcs, &hash);
+    } else if (slot->format == FT_GLYPH_FORMAT_BITMAP) {
+        const FT_Bitmap *bitmap = &slot->bitmap;
+        size_t pitch = bitmap->pitch < 0 ? -bitmap->pitch : bitmap->pitch;
+
+        hash_bytes(&hash, &bitmap->rows, sizeof(bitmap->rows));
+        hash_bytes(&hash, &bitmap->width, sizeof(bitmap->width));
+        if (bitmap->buffer) {
+            hash_bytes(&hash, bitmap->buffer, bitmap->rows * pitch);
+        }
+    }
+
+    return hash;
+}
+
+/*
+ * Hashes of the glyphs of one face, computed when first needed.
+ * Several characters are often mapped to the same glyph.
+ */
+struct glyph_hashes {
+    FT_Face face;
+    uint64_t *hashes;
+    bool *known;
+};
+
+static void glyph_hashes_init(struct glyph_hashes *h, FT_Face face)
+{
+    h->face = face;
+    h->hashes = calloc(face->num_glyphs, sizeof(uint64_t));
+    h->known = calloc(face->num_glyphs, sizeof(bool));
+
+    if (face->num_glyphs && (!h->hashes || !h->known)) {
+        perror("calloc");
+        exit(9);
+    }
+}
+
+static uint64_t glyph_hash(struct glyph_hashes *h, FT_UInt glyph)
+{
+    if (glyph >= (FT_ULong)h->face->num_glyphs) {
+        return glyph_outline_hash(h->face, glyph);
+    }
+
+    if (!h->known[glyph]) {
+        h->hashes[glyph] = glyph_outline_hash(h->face, glyph);
+        h->known[glyph] = true;
+    }
+
+    return h->hashes[glyph];
+}
+
+static void glyph_hashes_free(struct glyph_hashes *h)
+{
+    free(h->hashes);
+    free(h->known);
+}
+
+/*
+ * Find characters present in both faces whose glyphs differ.
+ * Returns a character bitmap of COVERAGE_WORDS words, it should be
+ * freed using free().
+ */
+uint64_t *glyph_diff_new(FT_Face face, const struct coverage *cov, FT_Face other_face,
+                         const struct coverage *other_cov)
+{
+    uint64_t *changed = calloc(COVERAGE_WORDS, sizeof(uint64_t));
+    if (!changed) {
+        perror("calloc");
+        exit(9);
+    }
+
+    struct glyph_hashes hashes, other_hashes;
+    glyph_hashes_init(&hashes, face);
+    glyph_hashes_init(&other_hashes, other_face);
+
+    for (uint32_t c = coverage_next(cov, 0); c != COVERAGE_END; c = coverage_next(cov, c + 1)) {
+        if (!coverage_has(other_cov, c)) {
+            continue;
+        }
+
+        uint64_t hash = glyph_hash(&hashes, coverage_glyph(cov, c));
+        uint64_t other_hash = glyph_hash(&other_hashes, coverage_glyph(other_cov, c));
+
+        if (hash != other_hash) {
+            changed[c / 64] |= UINT64_C(1) << (c % 64);
+        }
+    }
+
+    glyph_hashes_free(&hashes);
+    glyph_hashes_free(&other_hashes);
+
+    return changed;
+}
@@ -0,0 +1,19 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef GLYPH_DIFF_H
+#define GLYPH_DIFF_H
+
+#include <stdint.h>
+// TODO: freetype 2.10.3, do not include ft2build.h anymore
+#include <ft2build.h>
+#include <freetype/freetype.h>
+
+#include "coverage.h"
+
+uint64_t glyph_outline_hash(FT_Face face, FT_UInt glyph);
+uint64_t *glyph_diff_new(FT_Face face, const struct coverage *cov, FT_Face other_face,
+                         const struct coverage *other_cov);
+
+#endif
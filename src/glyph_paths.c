@@ -0,0 +1,243 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "glyph_paths.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <cairo-ft.h>
+#include <freetype/ftoutln.h>
+
+/*
+ * Paths of glyph outlines, decomposed once and shared by all threads
+ * drawing with the font.
+ */
+struct glyph_paths {
+    cairo_scaled_font_t *font;
+    double scale; /* user units per font unit, 0 if the font has no outlines */
+    GMutex lock;
+    GHashTable *paths; /* glyph index to cairo_path_t, NULL if there is no outline */
+};
+
+struct path_builder {
+    cairo_path_data_t *data;
+    int n;
+    int nalloc;
+    double scale;
+    FT_Vector current;
+};
+
+/*
+ * Append path element of the given type. Returns its points.
+ */
+static cairo_path_data_t *add_element(struct path_builder *b, cairo_path_data_type_t type,
+                                      int npoints)
+{
+    if (b->n + npoints + 1 > b->nalloc) {
+        int new_nalloc = b->nalloc ? 2 * b->nalloc : 64;
+        cairo_path_data_t *new_data = realloc(b->data, new_nalloc * sizeof(cairo_path_data_t));
+        if (!new_data) {
+            perror("realloc");
+            exit(9);
+        }
+        b->data = new_data;
+        b->nalloc = new_nalloc;
+    }
+
+    cairo_path_data_t *element = b->data + b->n;
+    element->header.type = type;
+    element->header.length = npoints + 1;
+    b->n += npoints + 1;
+
+    return element + 1;
+}
+
+/* Convert point in font units to user space, y axis points down in cairo */
+static void set_point(const struct path_builder *b, cairo_path_data_t *data, double x, double y)
+{
+    data->point.x = x * b->scale;
+    data->point.y = -y * b->scale;
+}
+
+static int path_move_to(const FT_Vector *to, void *user)
+{
+    struct path_builder *b = user;
+
+    if (b->n) {
+        add_element(b, CAIRO_PATH_CLOSE_PATH, 0);
+    }
+    set_point(b, add_element(b, CAIRO_PATH_MOVE_TO, 1), to->x, to->y);
+    b->current = *to;
+
+    return 0;
+}
+
+static int path_line_to(const FT_Vector *to, void *user)
+{
+    struct path_builder *b = user;
+
+    set_point(b, add_element(b, CAIRO_PATH_LINE_TO, 1), to->x, to->y);
+    b->current = *to;
+
+    return 0;
+}
+
+/* Quadratic curves are converted to cubic ones with the same shape */
+static int path_conic_to(const FT_Vector *control, const FT_Vector *to, void *user)
+{
+    struct path_builder *b = user;
+    cairo_path_data_t *points = add_element(b, CAIRO_PATH_CURVE_TO, 3);
+
+    set_point(b, points, b->current.x + 2.0 / 3.0 * (control->x - b->current.x),
+              b->current.y + 2.0 / 3.0 * (control->y - b->current.y));
+    set_point(b, points + 1, to->x + 2.0 / 3.0 * (control->x - to->x),
+              to->y + 2.0 / 3.0 * (control->y - to->y));
+    set_point(b, points + 2, to->x, to->y);
+    b->current = *to;
+
+    return 0;
+}
+
+static int path_cubic_to(const FT_Vector *control1, const FT_Vector *control2,
+                         const FT_Vector *to, void *user)
+{
+    struct path_builder *b = user;
+    cairo_path_data_t *points = add_element(b, CAIRO_PATH_CURVE_TO, 3);
+
+    set_point(b, points, control1->x, control1->y);
+    set_point(b, points + 1, control2->x, control2->y);
+    set_point(b, points + 2, to->x, to->y);
+    b->current = *to;
+
+    return 0;
+}
+
+static const FT_Outline_Funcs path_funcs = {
+    path_move_to, path_line_to, path_conic_to, path_cubic_to, 0, 0,
+};
+
+/*
+ * Decompose outline of the glyph in font units. Returns NULL if the glyph
+ * cannot be loaded or is not an outline, like glyphs of bitmap fonts.
+ */
+static cairo_path_t *decompose_glyph(struct glyph_paths *paths, unsigned long glyph)
+{
+    FT_Face face = cairo_ft_scaled_font_lock_face(paths->font);
+    if (!face) {
+        return NULL;
+    }
+
+    struct path_builder b = {.scale = paths->scale};
+    cairo_path_t *path = NULL;
+
+    if (!FT_Load_Glyph(face, glyph, FT_LOAD_NO_SCALE)
+        && face->glyph->format == FT_GLYPH_FORMAT_OUTLINE
+        && !FT_Outline_Decompose(&face->glyph->outline, &path_funcs, &b)) {
+        if (b.n) {
+            add_element(&b, CAIRO_PATH_CLOSE_PATH, 0);
+        }
+
+        path = malloc(sizeof(cairo_path_t));
+        if (!path) {
+            perror("malloc");
+            exit(9);
+        }
+        path->status = CAIRO_STATUS_SUCCESS;
+        path->data = b.data;
+        path->num_data = b.n;
+    } else {
+        free(b.data);
+    }
+
+    cairo_ft_scaled_font_unlock_face(paths->font);
+
+    return path;
+}
+
+static void free_path(gpointer data)
+{
+    cairo_path_t *path = data;
+
+    if (path) {
+        free(path->data);
+        free(path);
+    }
+}
+
+/*
+ * Create cache of glyph paths for the font. The font should be created
+ * with FreeType font face, 'size' is its size in user units.
+ */
+struct glyph_paths *glyph_paths_new(cairo_scaled_font_t *font, double size)
+{
+    struct glyph_paths *paths = malloc(sizeof(struct glyph_paths));
+    if (!paths) {
+        perror("malloc");
+        exit(9);
+    }
+
+    paths->font = cairo_scaled_font_reference(font);
+    paths->scale = 0.0;
+    g_mutex_init(&paths->lock);
+    paths->paths = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_path);
+
+    FT_Face face = cairo_ft_scaled_font_lock_face(font);
+    if (face) {
+        if (FT_IS_SCALABLE(face) && face->units_per_EM) {
+            paths->scale = size / face->units_per_EM;
+        }
+        cairo_ft_scaled_font_unlock_face(font);
+    }
+
+    return paths;
+}
+
+/*
+ * Find path of the glyph, decomposing its outline on first use.
+ */
+static const cairo_path_t *lookup_path(struct glyph_paths *paths, unsigned long glyph)
+{
+    gpointer key = GUINT_TO_POINTER(glyph);
+    gpointer path;
+
+    g_mutex_lock(&paths->lock);
+    if (!g_hash_table_lookup_extended(paths->paths, key, NULL, &path)) {
+        path = decompose_glyph(paths, glyph);
+        g_hash_table_insert(paths->paths, key, path);
+    }
+    g_mutex_unlock(&paths->lock);
+
+    return path;
+}
+
+/*
+ * Add outlines of the glyphs to the current path of 'cr', like
+ * cairo_glyph_path() does. Glyphs without outlines are left to cairo.
+ */
+void glyph_paths_append(struct glyph_paths *paths, cairo_t *cr, const cairo_glyph_t *glyphs,
+                        int nglyphs)
+{
+    cairo_matrix_t matrix;
+    cairo_get_matrix(cr, &matrix);
+
+    for (int i = 0; i < nglyphs; i++) {
+        const cairo_path_t *path = paths->scale > 0 ? lookup_path(paths, glyphs[i].index) : NULL;
+
+        if (path) {
+            cairo_translate(cr, glyphs[i].x, glyphs[i].y);
+            cairo_append_path(cr, path);
+            cairo_set_matrix(cr, &matrix);
+        } else {
+            cairo_set_scaled_font(cr, paths->font);
+            cairo_glyph_path(cr, glyphs + i, 1);
+        }
+    }
+}
+
+void glyph_paths_free(struct glyph_paths *paths)
+{
+    g_hash_table_destroy(paths->paths);
+    g_mutex_clear(&paths->lock);
+    cairo_scaled_font_destroy(paths->font);
+    free(paths);
+}
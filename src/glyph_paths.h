@@ -0,0 +1,17 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef GLYPH_PATHS_H
+#define GLYPH_PATHS_H
+
+#include <cairo.h>
+
+struct glyph_paths;
+
+struct glyph_paths *glyph_paths_new(cairo_scaled_font_t *font, double size);
+void glyph_paths_append(struct glyph_paths *paths, cairo_t *cr, const cairo_glyph_t *glyphs,
+                        int nglyphs);
+void glyph_paths_free(struct glyph_paths *paths);
+
+#endif
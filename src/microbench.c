@@ -0,0 +1,147 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Microbenchmarks of lookups done by fntsample for every character.
+ * Prints CSV rows with font file, benchmark name, number of operations
+ * and time per operation in nanoseconds. Font independent benchmarks
+ * have empty font file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <glib.h>
+// TODO: freetype 2.10.3, do not include ft2build.h anymore
+#include <ft2build.h>
+#include <freetype/freetype.h>
+
+#include "coverage.h"
+#include "ranges.h"
+#include "unicode_blocks.h"
+#include "static_unicode_blocks.h"
+
+#define REPEAT 10
+
+/* Keeps the compiler from optimizing the measured loops away */
+static volatile unsigned long sink;
+
+static void report(const char *font, const char *name, long ops, int64_t start)
+{
+    double ns = (g_get_monotonic_time() - start) * 1000.0 / (ops ? ops : 1);
+    printf("\"%s\",%s,%ld,%.2f\n", font, name, ops, ns);
+}
+
+static void bench_ranges(void)
+{
+    /* Some typical selections, add_range() modifies the strings */
+    char ranges[][16] = {"0-0x24f", "0x370-0x52f", "0x3000-0x9fff", "0x1f300-0x1faff"};
+    char excluded[] = "0x4e00-0x4fff";
+
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        add_range(ranges[i], true);
+    }
+    add_range(excluded, false);
+    finish_ranges();
+
+    unsigned long n = 0;
+    int64_t start = g_get_monotonic_time();
+    for (int r = 0; r < REPEAT; r++) {
+        for (uint32_t c = 0; c < COVERAGE_SIZE; c++) {
+            n += in_range(c);
+        }
+    }
+    sink = n;
+    report("", "in_range", (long)REPEAT * COVERAGE_SIZE, start);
+}
+
+static void bench_blocks(void)
+{
+    int nblocks = 0;
+    while (static_unicode_blocks[nblocks].name) {
+        nblocks++;
+    }
+
+    unsigned long n = 0;
+    int64_t start = g_get_monotonic_time();
+    for (int r = 0; r < REPEAT; r++) {
+        for (uint32_t c = 0; c < COVERAGE_SIZE; c++) {
+            n += static_unicode_block_index(c);
+        }
+    }
+    sink = n;
+    report("", "get_unicode_block_static", (long)REPEAT * COVERAGE_SIZE, start);
+
+    start = g_get_monotonic_time();
+    for (int r = 0; r < REPEAT; r++) {
+        for (uint32_t c = 0; c < COVERAGE_SIZE; c++) {
+            n += find_block(static_unicode_blocks, nblocks, c) != NULL;
+        }
+    }
+    sink = n;
+    report("", "get_unicode_block_search", (long)REPEAT * COVERAGE_SIZE, start);
+}
+
+static void bench_cmap(FT_Library library, const char *font)
+{
+    FT_Face face;
+
+    if (FT_New_Face(library, font, 0, &face)) {
+        fprintf(stderr, "%s: failed to open font file\n", font);
+        return;
+    }
+
+    long nchars = 0;
+    int64_t start = g_get_monotonic_time();
+    for (int r = 0; r < REPEAT; r++) {
+        FT_UInt idx;
+        for (FT_ULong c = FT_Get_First_Char(face, &idx); idx; c = FT_Get_Next_Char(face, c, &idx)) {
+            nchars++;
+        }
+    }
+    report(font, "cmap_walk", nchars, start);
+
+    struct coverage *cov = NULL;
+    start = g_get_monotonic_time();
+    for (int r = 0; r < REPEAT; r++) {
+        coverage_free(cov);
+        cov = coverage_new(face);
+    }
+    report(font, "coverage_new", nchars, start);
+
+    unsigned long n = 0;
+    start = g_get_monotonic_time();
+    for (int r = 0; r < REPEAT; r++) {
+        for (uint32_t c = coverage_next(cov, 0); c != COVERAGE_END; c = coverage_next(cov, c + 1)) {
+            n += coverage_glyph(cov, c);
+        }
+    }
+    sink = n;
+    report(font, "coverage_next", (long)REPEAT * cov->nchars, start);
+
+    coverage_free(cov);
+    FT_Done_Face(face);
+}
+
+int main(int argc, char **argv)
+{
+    FT_Library library;
+
+    if (FT_Init_FreeType(&library)) {
+        fprintf(stderr, "%s: freetype error\n", argv[0]);
+        return 3;
+    }
+
+    printf("font,benchmark,operations,ns_per_operation\n");
+
+    bench_ranges();
+    bench_blocks();
+
+    for (int i = 1; i < argc; i++) {
+        bench_cmap(library, argv[i]);
+    }
+
+    FT_Done_FreeType(library);
+
+    return 0;
+}
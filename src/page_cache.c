@@ -0,0 +1,134 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "page_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Pages are cached as files named after a checksum of everything that
+ * affects their contents. Files are written atomically, so a cache
+ * directory can be shared between threads and processes.
+ */
+
+void page_cache_add(GChecksum *checksum, const void *data, size_t len)
+{
+    g_checksum_update(checksum, data, len);
+}
+
+void page_cache_add_string(GChecksum *checksum, const char *s)
+{
+    /* Include terminating NUL, so consecutive strings are separated */
+    page_cache_add(checksum, s, strlen(s) + 1);
+}
+
+/*
+ * Add name and contents of a file to the checksum. Files that cannot
+ * be read only add their name.
+ */
+void page_cache_add_file(GChecksum *checksum, const char *file_name)
+{
+    GMappedFile *file = g_mapped_file_new(file_name, FALSE, NULL);
+
+    page_cache_add_string(checksum, file_name);
+    if (file) {
+        page_cache_add(checksum, g_mapped_file_get_contents(file), g_mapped_file_get_length(file));
+        g_mapped_file_unref(file);
+    }
+}
+
+/*
+ * Add glyph outline and metrics to the checksum. Glyph is loaded in
+ * font units, so the result does not depend on current character size.
+ */
+void page_cache_add_glyph(GChecksum *checksum, FT_Face face, FT_UInt glyph)
+{
+    FT_Error error = FT_Load_Glyph(face, glyph, FT_LOAD_NO_SCALE);
+    if (error) {
+        /* Bitmap only fonts cannot be loaded unscaled */
+        error = FT_Load_Glyph(face, glyph, FT_LOAD_DEFAULT);
+    }
+
+    page_cache_add(checksum, &error, sizeof(error));
+    if (error) {
+        page_cache_add(checksum, &glyph, sizeof(glyph));
+        return;
+    }
+
+    FT_GlyphSlot slot = face->glyph;
+    page_cache_add(checksum, &slot->format, sizeof(slot->format));
+    page_cache_add(checksum, &slot->metrics, sizeof(slot->metrics));
+
+    if (slot->format == FT_GLYPH_FORMAT_OUTLINE) {
+        const FT_Outline *outline = &slot->outline;
+
+        page_cache_add(checksum, &outline->n_contours, sizeof(outline->n_contours));
+        page_cache_add(checksum, &outline->n_points, sizeof(outline->n_points));
+        page_cache_add(checksum, outline->points, outline->n_points * sizeof(FT_Vector));
+        page_cache_add(checksum, outline->tags, outline->n_points);
+        page_cache_add(checksum, outline->contours,
+                       outline->n_contours * sizeof(outline->contours[0]));
+    } else if (slot->format == FT_GLYPH_FORMAT_BITMAP) {
+        const FT_Bitmap *bitmap = &slot->bitmap;
+        size_t pitch = bitmap->pitch < 0 ? -bitmap->pitch : bitmap->pitch;
+
+        page_cache_add(checksum, &bitmap->rows, sizeof(bitmap->rows));
+        page_cache_add(checksum, &bitmap->width, sizeof(bitmap->width));
+        if (bitmap->buffer) {
+            page_cache_add(checksum, bitmap->buffer, bitmap->rows * pitch);
+        }
+    }
+}
+
+static char *cache_file_name(const char *cache_dir, const char *key, const char *ext)
+{
+    char *base = g_strdup_printf("%s%s", key, ext);
+    char *name = g_build_filename(cache_dir, base, NULL);
+    g_free(base);
+
+    return name;
+}
+
+static bool copy_file(const char *src, const char *dest)
+{
+    gchar *contents;
+    gsize len;
+
+    if (!g_file_get_contents(src, &contents, &len, NULL)) {
+        return false;
+    }
+
+    GError *error = NULL;
+    bool ok = g_file_set_contents(dest, contents, len, &error);
+    if (!ok) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+    }
+
+    g_free(contents);
+    return ok;
+}
+
+/*
+ * Copy cached file with the given key to dest.
+ * Returns true if the file was found in the cache.
+ */
+bool page_cache_fetch(const char *cache_dir, const char *key, const char *ext, const char *dest)
+{
+    char *name = cache_file_name(cache_dir, key, ext);
+    bool found = copy_file(name, dest);
+    g_free(name);
+
+    return found;
+}
+
+/*
+ * Store file src in the cache under the given key.
+ * Failures are not fatal, the page will be rendered again next time.
+ */
+void page_cache_store(const char *cache_dir, const char *key, const char *ext, const char *src)
+{
+    char *name = cache_file_name(cache_dir, key, ext);
+    copy_file(src, name);
+    g_free(name);
+}
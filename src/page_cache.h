@@ -0,0 +1,23 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <glib.h>
+// TODO: freetype 2.10.3, do not include ft2build.h anymore
+#include <ft2build.h>
+#include <freetype/freetype.h>
+
+void page_cache_add(GChecksum *checksum, const void *data, size_t len);
+void page_cache_add_string(GChecksum *checksum, const char *s);
+void page_cache_add_file(GChecksum *checksum, const char *file_name);
+void page_cache_add_glyph(GChecksum *checksum, FT_Face face, FT_UInt glyph);
+
+bool page_cache_fetch(const char *cache_dir, const char *key, const char *ext, const char *dest);
+void page_cache_store(const char *cache_dir, const char *key, const char *ext, const char *src);
+
+#endif
@@ -0,0 +1,180 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "ranges.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "coverage.h"
+
+/* Characters selected by the user as a sorted list of disjoint ranges */
+static struct range *ranges;
+static int nranges;
+static bool ranges_given;
+
+/*
+ * Add characters from first to last to the set of selected characters,
+ * or remove them from the set if include is false. The set is kept
+ * sorted, and adjacent ranges are merged.
+ *
+ * Returns -1 on error.
+ */
+static int update_ranges(uint32_t first, uint32_t last, bool include)
+{
+    struct range *new_ranges = malloc((nranges + 1) * sizeof(struct range));
+    if (!new_ranges) {
+        return -1;
+    }
+
+    int n = 0;
+    int i = 0;
+
+    if (include) {
+        /* copy ranges that end before the new one and are not adjacent to it */
+        for (; i < nranges && first > 0 && ranges[i].last < first - 1; i++) {
+            new_ranges[n++] = ranges[i];
+        }
+
+        struct range merged = {first, last};
+        for (; i < nranges && (last == UINT32_MAX || ranges[i].first <= last + 1); i++) {
+            if (ranges[i].first < merged.first) {
+                merged.first = ranges[i].first;
+            }
+            if (ranges[i].last > merged.last) {
+                merged.last = ranges[i].last;
+            }
+        }
+        new_ranges[n++] = merged;
+
+        for (; i < nranges; i++) {
+            new_ranges[n++] = ranges[i];
+        }
+    } else {
+        for (; i < nranges; i++) {
+            struct range r = ranges[i];
+
+            if (r.last < first || r.first > last) {
+                new_ranges[n++] = r;
+                continue;
+            }
+
+            if (r.first < first) {
+                new_ranges[n++] = (struct range){r.first, first - 1};
+            }
+
+            if (r.last > last) {
+                new_ranges[n++] = (struct range){last + 1, r.last};
+            }
+        }
+    }
+
+    free(ranges);
+    ranges = new_ranges;
+    nranges = n;
+
+    return 0;
+}
+
+/*
+ * Update output range.
+ *
+ * Returns -1 on error.
+ */
+int add_range(char *range, bool include)
+{
+    uint32_t first = 0, last = 0xffffffff;
+    char *endptr;
+
+    char *minus = strchr(range, '-');
+
+    if (minus) {
+        if (minus != range) {
+            *minus = '\0';
+            first = strtoul(range, &endptr, 0);
+            if (*endptr) {
+                return -1;
+            }
+        }
+
+        if (*(minus + 1)) {
+            last = strtoul(minus + 1, &endptr, 0);
+            if (*endptr) {
+                return -1;
+            }
+        } else if (minus == range) {
+            return -1;
+        }
+    } else {
+        first = strtoul(range, &endptr, 0);
+        if (*endptr)
+            return -1;
+        last = first;
+    }
+
+    if (first > last) {
+        return -1;
+    }
+
+    if (!ranges_given) {
+        /* If the first range excludes characters, all other characters are shown */
+        if (!include && update_ranges(0, 0xffffffff, true)) {
+            return -1;
+        }
+        ranges_given = true;
+    }
+
+    return update_ranges(first, last, include);
+}
+
+/*
+ * Locate the first range that ends at or after the given character code.
+ * Returns NULL if there is no such range.
+ */
+const struct range *find_range(uint32_t c)
+{
+    int lo = 0;
+    int hi = nranges;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ranges[mid].last < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo < nranges ? ranges + lo : NULL;
+}
+
+/*
+ * Check if character with the given code belongs
+ * to output range specified by the user.
+ */
+bool in_range(uint32_t c)
+{
+    const struct range *r = find_range(c);
+    return r && c >= r->first;
+}
+
+/*
+ * Select all characters if no ranges were given by the user.
+ *
+ * Returns -1 on error.
+ */
+int finish_ranges(void)
+{
+    return ranges_given ? 0 : update_ranges(0, 0xffffffff, true);
+}
+
+/*
+ * Set bits of the selected characters in a character bitmap
+ * of COVERAGE_WORDS words.
+ */
+void ranges_mask(uint64_t *bits)
+{
+    for (int i = 0; i < nranges && ranges[i].first < COVERAGE_SIZE; i++) {
+        uint32_t last = ranges[i].last < COVERAGE_SIZE ? ranges[i].last : COVERAGE_SIZE - 1;
+        coverage_bits_set_range(bits, ranges[i].first, last);
+    }
+}
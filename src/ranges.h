@@ -0,0 +1,22 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef RANGES_H
+#define RANGES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct range {
+    uint32_t first;
+    uint32_t last;
+};
+
+int add_range(char *range, bool include);
+int finish_ranges(void);
+const struct range *find_range(uint32_t c);
+bool in_range(uint32_t c);
+void ranges_mask(uint64_t *bits);
+
+#endif
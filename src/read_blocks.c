@@ -5,65 +5,534 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libintl.h>
 
+#define _(str) gettext(str)
+
+/*
+ * Map the whole file into memory, 'st' receives the file status.
+ * Returns NULL for empty files and MAP_FAILED on errors.
+ */
+static const char *map_file(const char *file_name, struct stat *st)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return MAP_FAILED;
+    }
+
+    const char *data = MAP_FAILED;
+    if (!fstat(fd, st)) {
+        data = st->st_size ? mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    }
+
+    close(fd);
+    return data;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/*
+ * Parse a character code. Returns pointer to the first character
+ * after it, or NULL if there is no valid code.
+ */
+static const char *parse_code(const char *p, const char *end, unsigned long *code)
+{
+    const char *start = p;
+    int d;
+
+    *code = 0;
+    for (; p < end && (d = hex_digit(*p)) >= 0; p++) {
+        if (*code > 0x10FFFF) {
+            return NULL;
+        }
+        *code = *code * 16 + d;
+    }
+
+    return p == start ? NULL : p;
+}
+
+static const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+
+    return p;
+}
+
+/*
+ * Parse a line of the form "START..END; NAME". Name is copied into
+ * the arena. Returns false if the line is not a valid block definition.
+ */
+static bool parse_block(const char *p, const char *end, struct unicode_block *block, char **arena)
+{
+    unsigned long start, last;
+
+    if (!(p = parse_code(p, end, &start)) || end - p < 2 || p[0] != '.' || p[1] != '.'
+        || !(p = parse_code(p + 2, end, &last))) {
+        return false;
+    }
+
+    p = skip_blanks(p, end);
+    if (p == end || *p++ != ';') {
+        return false;
+    }
+
+    p = skip_blanks(p, end);
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+        end--;
+    }
+    if (p == end) {
+        return false;
+    }
+
+    block->start = start;
+    block->end = last;
+    block->name = *arena;
+    memcpy(*arena, p, end - p);
+    *arena += end - p;
+    *(*arena)++ = '\0';
+
+    return true;
+}
+
+/*
+ * Read blocks from a Unicode Blocks.txt file. The file is parsed in one
+ * pass from a memory mapping. Blocks and their names are returned in
+ * a single allocation, that should be freed with free(). Empty lines
+ * and comments starting with # are skipped, other lines should define
+ * blocks.
+ *
+ * Returns NULL if the file contains no blocks or has invalid lines.
+ */
 struct unicode_block *read_blocks(const char *file_name, int *n)
 {
-    int nalloc = 256;
-    struct unicode_block *blocks = calloc(nalloc, sizeof(struct unicode_block));
-    *n = 0;
+    struct stat st;
+    const char *data = map_file(file_name, &st);
 
-    FILE *input_file = fopen(file_name, "r");
-    if (!input_file) {
-        perror("fopen");
+    *n = 0;
+    if (data == MAP_FAILED) {
+        perror(file_name);
         exit(7);
+    } else if (!data) {
+        return NULL;
     }
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t nread;
+    const char *data_end = data + st.st_size;
 
-    while ((nread = getline(&line, &len, input_file)) != -1) {
-        unsigned long block_start, block_end;
-        char block_name[256];
+    /* Each block needs a line, and a name not longer than the line */
+    size_t nlines = 1;
+    for (const char *p = data; (p = memchr(p, '\n', data_end - p)); p++) {
+        nlines++;
+    }
 
-        if (nread >= (ssize_t)sizeof(block_name))
+    struct unicode_block *blocks = malloc(nlines * sizeof(struct unicode_block) + st.st_size);
+    if (!blocks) {
+        perror("malloc");
+        exit(9);
+    }
+
+    char *arena = (char *)(blocks + nlines);
+    int lineno = 0;
+
+    for (const char *line = data; line < data_end;) {
+        const char *line_end = memchr(line, '\n', data_end - line);
+        if (!line_end) {
+            line_end = data_end;
+        }
+        lineno++;
+
+        const char *p = skip_blanks(line, line_end);
+        line = line_end + 1;
+
+        if (p == line_end || *p == '#' || *p == '\r') {
             continue;
+        }
+
+        if (!parse_block(p, line_end, blocks + *n, &arena)) {
+            fprintf(stderr, _("%s:%d: invalid block definition\n"), file_name, lineno);
+            free(blocks);
+            blocks = NULL;
+            *n = 0;
+            break;
+        }
+
+        *n += 1;
+    }
+
+    munmap((void *)data, st.st_size);
+
+    if (blocks && *n == 0) {
+        free(blocks);
+        blocks = NULL;
+    }
+
+    return blocks;
+}
+
+static int compare_blocks(const void *a, const void *b)
+{
+    const struct unicode_block *block_a = a;
+    const struct unicode_block *block_b = b;
+
+    if (block_a->start < block_b->start) {
+        return -1;
+    }
+
+    return block_a->start > block_b->start;
+}
+
+/*
+ * Check that sorted blocks have valid ranges and do not overlap.
+ */
+static bool blocks_valid(const struct unicode_block *blocks, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (blocks[i].start > blocks[i].end) {
+            return false;
+        }
+
+        if (i > 0 && blocks[i].start <= blocks[i - 1].end) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Sort blocks by their start and check that they do not overlap,
+ * so they can be searched using binary search.
+ *
+ * Returns -1 if the blocks are not valid.
+ */
+int sort_blocks(struct unicode_block *blocks, int n)
+{
+    qsort(blocks, n, sizeof(struct unicode_block), compare_blocks);
+
+    return blocks_valid(blocks, n) ? 0 : -1;
+}
+
+/*
+ * Find block that contains the given character in blocks sorted
+ * with sort_blocks(). Returns NULL if there is no such block.
+ */
+const struct unicode_block *find_block(const struct unicode_block *blocks, int n,
+                                       unsigned long charcode)
+{
+    int lo = 0;
+    int hi = n;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const struct unicode_block *block = blocks + mid;
+
+        if (charcode < block->start) {
+            hi = mid;
+        } else if (charcode > block->end) {
+            lo = mid + 1;
+        } else {
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Build lookup table that maps characters to blocks. 'rows' should have
+ * space for BLOCK_LOOKUP_PAGES + 1 rows. Blocks should be sorted and
+ * aligned to 16 characters. Identical rows are shared between pages.
+ *
+ * Returns number of rows used.
+ */
+int build_block_lookup(const struct unicode_block *blocks, int n, uint16_t *pages,
+                       uint16_t (*rows)[16])
+{
+    /* Row 0 does not belong to any block, other rows are unique */
+    int nrows = 1;
+    int b = 0;
+
+    memset(rows[0], 0, sizeof(rows[0]));
+
+    for (unsigned long page = 0; page < BLOCK_LOOKUP_PAGES; page++) {
+        uint16_t row[16];
 
-        int matched = sscanf(line, "%lx..%lx; %[^\r\n]", &block_start, &block_end, block_name);
-        if (matched == 3) {
-            struct unicode_block *b = blocks + *n;
-            b->start = block_start;
-            b->end = block_end;
-            b->name = strdup(block_name);
-            if (b->name == NULL) {
-                perror("strdup");
-                exit(8);
+        for (unsigned long i = 0; i < 16; i++) {
+            unsigned long c = page * 256 + i * 16;
+
+            while (b < n && blocks[b].end < c) {
+                b++;
             }
 
-            *n += 1;
-            if (*n >= nalloc) {
-                int new_nalloc = nalloc + 256;
-                struct unicode_block *new_blocks
-                    = realloc(blocks, new_nalloc * sizeof(struct unicode_block));
-                if (new_blocks == NULL) {
-                    perror("realloc");
-                    exit(9);
-                }
-                memset(new_blocks + nalloc, 0,
-                       (new_nalloc - nalloc) * sizeof(struct unicode_block));
-                nalloc = new_nalloc;
-                blocks = new_blocks;
+            row[i] = (b < n && blocks[b].start <= c) ? b + 1 : 0;
+        }
+
+        int r;
+        for (r = 0; r < nrows; r++) {
+            if (!memcmp(rows[r], row, sizeof(row))) {
+                break;
             }
         }
+
+        if (r == nrows) {
+            memcpy(rows[nrows++], row, sizeof(row));
+        }
+
+        pages[page] = r;
+    }
+
+    return nrows;
+}
+
+/*
+ * Check if blocks can be described by a lookup table.
+ */
+bool blocks_aligned(const struct unicode_block *blocks, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (blocks[i].start % 16 || (blocks[i].end + 1) % 16
+            || blocks[i].end >= BLOCK_LOOKUP_PAGES * 256) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Binary form of a blocks file. It is followed by 'nblocks' entries,
+ * the lookup table ('nrows' is 0 if blocks are not aligned) and block
+ * names. Source size and modification time are used to check that the
+ * cache is up to date.
+ */
+#define BLOCKS_CACHE_MAGIC "FNTBLKS1"
+
+struct blocks_cache_header {
+    char magic[8];
+    uint32_t nblocks;
+    uint32_t nrows;
+    uint32_t names_size;
+    uint32_t reserved;
+    int64_t source_size;
+    int64_t source_mtime;
+};
+
+struct blocks_cache_entry {
+    uint32_t start;
+    uint32_t end;
+    uint32_t name;
+};
+
+/*
+ * Write sorted blocks read from 'source_name' into a cache file.
+ * Returns -1 on failure.
+ */
+int write_blocks_cache(const char *file_name, const char *source_name,
+                       const struct unicode_block *blocks, int n)
+{
+    struct stat st;
+    if (stat(source_name, &st)) {
+        return -1;
+    }
+
+    struct blocks_cache_header header = {
+        .magic = BLOCKS_CACHE_MAGIC,
+        .nblocks = n,
+        .source_size = st.st_size,
+        .source_mtime = st.st_mtime,
+    };
+
+    static uint16_t rows[BLOCK_LOOKUP_PAGES + 1][16];
+    static uint16_t pages[BLOCK_LOOKUP_PAGES];
+    if (blocks_aligned(blocks, n)) {
+        header.nrows = build_block_lookup(blocks, n, pages, rows);
+    }
+
+    struct blocks_cache_entry *entries = calloc(n, sizeof(struct blocks_cache_entry));
+    if (n && !entries) {
+        perror("calloc");
+        exit(9);
+    }
+
+    for (int i = 0; i < n; i++) {
+        entries[i].start = blocks[i].start;
+        entries[i].end = blocks[i].end;
+        entries[i].name = header.names_size;
+        header.names_size += strlen(blocks[i].name) + 1;
+    }
+
+    /* Write to a temporary file first, so readers never see a partial cache */
+    size_t tmp_len = strlen(file_name) + 8;
+    char *tmp_name = malloc(tmp_len);
+    if (!tmp_name) {
+        perror("malloc");
+        exit(9);
+    }
+    snprintf(tmp_name, tmp_len, "%s.XXXXXX", file_name);
+
+    int fd = mkstemp(tmp_name);
+    if (fd >= 0) {
+        /* mkstemp() creates files only readable by the owner */
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+    }
+
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "wb");
+    bool ok = f != NULL;
+
+    if (ok) {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1
+            && fwrite(entries, sizeof(struct blocks_cache_entry), n, f) == (size_t)n
+            && fwrite(pages, sizeof(uint16_t), header.nrows ? BLOCK_LOOKUP_PAGES : 0, f)
+                == (header.nrows ? BLOCK_LOOKUP_PAGES : 0)
+            && fwrite(rows, sizeof(rows[0]), header.nrows, f) == header.nrows;
+
+        for (int i = 0; ok && i < n; i++) {
+            ok = fwrite(blocks[i].name, strlen(blocks[i].name) + 1, 1, f) == 1;
+        }
+
+        ok = !fclose(f) && ok && !rename(tmp_name, file_name);
+    } else if (fd >= 0) {
+        close(fd);
     }
-    free(line);
 
-    if (*n == 0) {
+    if (!ok && fd >= 0) {
+        unlink(tmp_name);
+    }
+
+    free(tmp_name);
+    free(entries);
+
+    return ok ? 0 : -1;
+}
+
+/*
+ * Check that the mapped cache of 'size' bytes is complete, consistent
+ * and was made from the current version of the source file.
+ */
+static bool blocks_cache_valid(const struct blocks_cache_header *header, size_t size,
+                               const struct stat *source_st)
+{
+    if (size < sizeof(*header) || memcmp(header->magic, BLOCKS_CACHE_MAGIC, sizeof(header->magic))
+        || header->source_size != source_st->st_size
+        || header->source_mtime != source_st->st_mtime || header->nblocks == 0
+        || header->nblocks >= BLOCK_LOOKUP_PAGES * 256 || header->nrows > BLOCK_LOOKUP_PAGES + 1
+        || header->names_size == 0) {
+        return false;
+    }
+
+    size_t tables_size = header->nblocks * sizeof(struct blocks_cache_entry)
+        + (header->nrows ? BLOCK_LOOKUP_PAGES * sizeof(uint16_t) : 0)
+        + header->nrows * 16 * sizeof(uint16_t);
+    if (size != sizeof(*header) + tables_size + header->names_size) {
+        return false;
+    }
+
+    const struct blocks_cache_entry *entries = (const void *)(header + 1);
+    const uint16_t *pages = (const uint16_t *)(entries + header->nblocks);
+    const uint16_t(*rows)[16] = (const void *)(pages + (header->nrows ? BLOCK_LOOKUP_PAGES : 0));
+    const char *names = (const char *)(rows + header->nrows);
+
+    if (names[header->names_size - 1] != '\0') {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->nblocks; i++) {
+        if (entries[i].name >= header->names_size) {
+            return false;
+        }
+    }
+
+    /* Entries of the table are used as indices, so they are checked once here */
+    for (uint32_t i = 0; header->nrows && i < BLOCK_LOOKUP_PAGES; i++) {
+        if (pages[i] >= header->nrows) {
+            return false;
+        }
+    }
+
+    for (uint32_t r = 0; r < header->nrows; r++) {
+        for (int i = 0; i < 16; i++) {
+            if (rows[r][i] > header->nblocks) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Map a cache written by write_blocks_cache(). Names and lookup table
+ * point into the mapping, that is kept until the program exits. Only
+ * the array of blocks is allocated, it should be freed with free().
+ * Lookup table pointers are NULL if the cache has no table.
+ *
+ * Returns NULL if the cache does not exist, is not valid or does not
+ * match 'source_name'.
+ */
+struct unicode_block *read_blocks_cache(const char *file_name, const char *source_name, int *n,
+                                        struct block_lookup *lookup)
+{
+    struct stat source_st, st;
+
+    *n = 0;
+    if (stat(source_name, &source_st)) {
+        return NULL;
+    }
+
+    const struct blocks_cache_header *header = (const void *)map_file(file_name, &st);
+    if (header == MAP_FAILED || !header) {
+        return NULL;
+    }
+
+    if (!blocks_cache_valid(header, st.st_size, &source_st)) {
+        munmap((void *)header, st.st_size);
+        return NULL;
+    }
+
+    const struct blocks_cache_entry *entries = (const void *)(header + 1);
+    const uint16_t *pages = (const uint16_t *)(entries + header->nblocks);
+    const uint16_t(*rows)[16] = (const void *)(pages + (header->nrows ? BLOCK_LOOKUP_PAGES : 0));
+    const char *names = (const char *)(rows + header->nrows);
+
+    struct unicode_block *blocks = malloc(header->nblocks * sizeof(struct unicode_block));
+    if (!blocks) {
+        perror("malloc");
+        exit(9);
+    }
+
+    for (uint32_t i = 0; i < header->nblocks; i++) {
+        blocks[i].start = entries[i].start;
+        blocks[i].end = entries[i].end;
+        blocks[i].name = names + entries[i].name;
+    }
+
+    if (!blocks_valid(blocks, header->nblocks)) {
         free(blocks);
+        munmap((void *)header, st.st_size);
         return NULL;
-    } else if (*n < nalloc) {
-        blocks = realloc(blocks, *n * sizeof(struct unicode_block));
     }
 
+    lookup->pages = header->nrows ? pages : NULL;
+    lookup->rows = header->nrows ? rows : NULL;
+    *n = header->nblocks;
+
     return blocks;
 }
@@ -0,0 +1,206 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "report.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+/*
+ * Character sets compared by the report, all limited to the selected ranges.
+ */
+struct report_sets {
+    uint64_t chars[COVERAGE_WORDS];
+    uint64_t added[COVERAGE_WORDS];
+    uint64_t removed[COVERAGE_WORDS];
+    bool diff;
+};
+
+static void compute_sets(struct report_sets *sets, const uint64_t *mask,
+                         const struct coverage *cov, const struct coverage *other_cov)
+{
+    sets->diff = other_cov != NULL;
+
+    for (int i = 0; i < COVERAGE_WORDS; i++) {
+        sets->chars[i] = cov->chars[i] & mask[i];
+
+        if (other_cov) {
+            uint64_t other = other_cov->chars[i] & mask[i];
+            sets->added[i] = sets->chars[i] & ~other;
+            sets->removed[i] = other & ~sets->chars[i];
+        }
+    }
+}
+
+/*
+ * Print characters from the bitmap between 'first' and 'last' as a list
+ * of U+XXXX values separated by 'sep', each enclosed in 'quote'.
+ */
+static void print_chars(FILE *f, const uint64_t *bits, uint32_t first, uint32_t last,
+                        const char *sep, const char *quote)
+{
+    const char *s = "";
+
+    for (uint32_t c = coverage_bits_next(bits, first); c <= last;
+         c = coverage_bits_next(bits, c + 1)) {
+        fprintf(f, "%s%sU+%04X%s", s, quote, (unsigned int)c, quote);
+        s = sep;
+    }
+}
+
+/*
+ * Write a string as a quoted JSON string.
+ */
+void print_json_string(FILE *f, const char *s)
+{
+    putc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(f, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(f, "\\u%04x", (unsigned char)*s);
+        } else {
+            putc(*s, f);
+        }
+    }
+    putc('"', f);
+}
+
+static void print_csv_string(FILE *f, const char *s)
+{
+    putc('"', f);
+    for (; *s; s++) {
+        if (*s == '"') {
+            putc('"', f);
+        }
+        putc(*s, f);
+    }
+    putc('"', f);
+}
+
+static uint32_t block_last(const struct unicode_block *block)
+{
+    return block->end < COVERAGE_SIZE ? block->end : COVERAGE_SIZE - 1;
+}
+
+static void write_json(FILE *f, const struct unicode_block *blocks, int nblocks,
+                       const struct report_sets *sets)
+{
+    unsigned long total = coverage_bits_count(sets->chars, 0, COVERAGE_SIZE - 1);
+    unsigned long in_blocks = 0;
+    const char *sep = "";
+
+    fprintf(f, "{\n  \"blocks\": [");
+
+    for (int i = 0; i < nblocks; i++) {
+        const struct unicode_block *b = blocks + i;
+        if (b->start >= COVERAGE_SIZE) {
+            continue;
+        }
+
+        uint32_t last = block_last(b);
+        unsigned long count = coverage_bits_count(sets->chars, b->start, last);
+        unsigned long removed = sets->diff ? coverage_bits_count(sets->removed, b->start, last) : 0;
+
+        in_blocks += count;
+        if (!count && !removed) {
+            continue;
+        }
+
+        fprintf(f, "%s\n    {\"name\": ", sep);
+        print_json_string(f, b->name);
+        fprintf(f, ", \"start\": \"U+%04lX\", \"end\": \"U+%04lX\", \"count\": %lu", b->start,
+                b->end, count);
+
+        if (sets->diff) {
+            fprintf(f, ", \"added\": [");
+            print_chars(f, sets->added, b->start, last, ", ", "\"");
+            fprintf(f, "], \"removed\": [");
+            print_chars(f, sets->removed, b->start, last, ", ", "\"");
+            fprintf(f, "]");
+        }
+
+        fprintf(f, "}");
+        sep = ",";
+    }
+
+    fprintf(f, "\n  ],\n  \"total\": %lu,\n  \"outside_blocks\": %lu", total, total - in_blocks);
+
+    if (sets->diff) {
+        fprintf(f, ",\n  \"added\": %lu,\n  \"removed\": %lu",
+                coverage_bits_count(sets->added, 0, COVERAGE_SIZE - 1),
+                coverage_bits_count(sets->removed, 0, COVERAGE_SIZE - 1));
+    }
+
+    fprintf(f, "\n}\n");
+}
+
+static void write_csv(FILE *f, const struct unicode_block *blocks, int nblocks,
+                      const struct report_sets *sets)
+{
+    unsigned long total = coverage_bits_count(sets->chars, 0, COVERAGE_SIZE - 1);
+    unsigned long total_added = 0;
+    unsigned long total_removed = 0;
+
+    fprintf(f, "block,start,end,count,added,removed,added_chars,removed_chars\n");
+
+    for (int i = 0; i < nblocks; i++) {
+        const struct unicode_block *b = blocks + i;
+        if (b->start >= COVERAGE_SIZE) {
+            continue;
+        }
+
+        uint32_t last = block_last(b);
+        unsigned long count = coverage_bits_count(sets->chars, b->start, last);
+        unsigned long added = sets->diff ? coverage_bits_count(sets->added, b->start, last) : 0;
+        unsigned long removed = sets->diff ? coverage_bits_count(sets->removed, b->start, last) : 0;
+
+        if (!count && !removed) {
+            continue;
+        }
+
+        print_csv_string(f, b->name);
+        fprintf(f, ",U+%04lX,U+%04lX,%lu,%lu,%lu,", b->start, b->end, count, added, removed);
+        if (sets->diff) {
+            print_chars(f, sets->added, b->start, last, " ", "");
+            putc(',', f);
+            print_chars(f, sets->removed, b->start, last, " ", "");
+        } else {
+            putc(',', f);
+        }
+        putc('\n', f);
+    }
+
+    if (sets->diff) {
+        total_added = coverage_bits_count(sets->added, 0, COVERAGE_SIZE - 1);
+        total_removed = coverage_bits_count(sets->removed, 0, COVERAGE_SIZE - 1);
+    }
+
+    /* The last row has totals for all characters, including ones outside of blocks */
+    fprintf(f, ",,,%lu,%lu,%lu,,\n", total, total_added, total_removed);
+}
+
+/*
+ * Write report of characters supported by the font per Unicode block.
+ * Only characters set in 'mask' are counted. If 'other_cov' is given,
+ * the report also lists characters added and removed relative to it.
+ */
+void write_coverage_report(FILE *f, enum report_format format, const struct unicode_block *blocks,
+                           int nblocks, const uint64_t *mask, const struct coverage *cov,
+                           const struct coverage *other_cov)
+{
+    struct report_sets *sets = malloc(sizeof(struct report_sets));
+    if (!sets) {
+        perror("malloc");
+        exit(9);
+    }
+
+    compute_sets(sets, mask, cov, other_cov);
+
+    if (format == REPORT_CSV) {
+        write_csv(f, blocks, nblocks, sets);
+    } else {
+        write_json(f, blocks, nblocks, sets);
+    }
+
+    free(sets);
+}
@@ -0,0 +1,25 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "coverage.h"
+#include "unicode_blocks.h"
+
+enum report_format {
+    REPORT_NONE,
+    REPORT_JSON,
+    REPORT_CSV,
+};
+
+void write_coverage_report(FILE *f, enum report_format format, const struct unicode_block *blocks,
+                           int nblocks, const uint64_t *mask, const struct coverage *cov,
+                           const struct coverage *other_cov);
+void print_json_string(FILE *f, const char *s);
+
+#endif
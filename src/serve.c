@@ -0,0 +1,302 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "serve.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <libintl.h>
+
+#define _(str) gettext(str)
+
+#define MAX_REQUEST_SIZE (64 * 1024)
+#define FRAME_SIZE (64 * 1024)
+/* Seconds to wait for the request before the connection is dropped */
+#define REQUEST_TIMEOUT 30
+
+static bool write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+static bool write_u32(int fd, uint32_t value)
+{
+    const unsigned char buf[4] = {value >> 24, value >> 16, value >> 8, value};
+
+    return write_all(fd, buf, sizeof(buf));
+}
+
+/*
+ * Read request arguments. Returned array and strings are in one
+ * allocation, NULL is returned if the request is not valid or is not
+ * received in time.
+ */
+static char **read_request(int conn, const char *prog, int *argc)
+{
+    char *buf = malloc(MAX_REQUEST_SIZE);
+    if (!buf) {
+        perror("malloc");
+        exit(9);
+    }
+
+    size_t len = 0;
+    size_t arg_start = 0;
+    int nargs = 0;
+    bool done = false;
+
+    while (!done && len < MAX_REQUEST_SIZE) {
+        ssize_t n = read(conn, buf + len, MAX_REQUEST_SIZE - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+
+        for (size_t i = len; i < len + n && !done; i++) {
+            if (buf[i]) {
+                continue;
+            } else if (i == arg_start) {
+                done = true;
+            } else {
+                nargs++;
+                arg_start = i + 1;
+            }
+        }
+        len += n;
+    }
+
+    if (!done) {
+        free(buf);
+        return NULL;
+    }
+
+    char **argv = malloc((nargs + 2) * sizeof(char *) + arg_start);
+    if (!argv) {
+        perror("malloc");
+        exit(9);
+    }
+
+    char *args = (char *)(argv + nargs + 2);
+    memcpy(args, buf, arg_start);
+    free(buf);
+
+    argv[0] = (char *)prog;
+    for (int i = 1; i <= nargs; i++) {
+        argv[i] = args;
+        args += strlen(args) + 1;
+    }
+    argv[nargs + 1] = NULL;
+    *argc = nargs + 1;
+
+    return argv;
+}
+
+/*
+ * Send the end of the output, exit status and messages of the job.
+ */
+static void send_status(int conn, int status, FILE *log)
+{
+    char *messages = NULL;
+    long len = 0;
+
+    if (log && fseek(log, 0, SEEK_END) == 0 && (len = ftell(log)) > 0) {
+        messages = malloc(len);
+        rewind(log);
+        if (!messages || fread(messages, 1, len, log) != (size_t)len) {
+            len = 0;
+        }
+    }
+
+    if (len < 0) {
+        len = 0;
+    }
+
+    if (write_u32(conn, 0) && write_u32(conn, status) && write_u32(conn, len)) {
+        write_all(conn, messages, len);
+    }
+
+    free(messages);
+}
+
+/*
+ * Handle one connection in its own process. The job runs in a child
+ * process that writes output to a pipe, and messages to a temporary
+ * file. Output is sent to the client in frames as it is produced.
+ */
+static void handle_connection(int conn, const char *prog, serve_job_func func)
+{
+    /* Connections count as running jobs, idle clients should not keep them */
+    const struct timeval timeout = {.tv_sec = REQUEST_TIMEOUT};
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int argc;
+    char **argv = read_request(conn, prog, &argc);
+    if (!argv) {
+        send_status(conn, 1, NULL);
+        exit(1);
+    }
+
+    int fds[2];
+    FILE *log = tmpfile();
+    if (!log || pipe(fds)) {
+        perror("serve");
+        send_status(conn, 1, NULL);
+        exit(1);
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        send_status(conn, 1, NULL);
+        exit(1);
+    } else if (pid == 0) {
+        close(conn);
+        close(fds[0]);
+        dup2(fileno(log), STDOUT_FILENO);
+        dup2(fileno(log), STDERR_FILENO);
+        exit(func(argc, argv, fds[1]));
+    }
+
+    close(fds[1]);
+
+    char *frame = malloc(FRAME_SIZE);
+    if (!frame) {
+        perror("malloc");
+        exit(9);
+    }
+
+    bool connected = true;
+    for (;;) {
+        ssize_t n = read(fds[0], frame, FRAME_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+
+        if (connected && !(write_u32(conn, n) && write_all(conn, frame, n))) {
+            /* The client is gone, output is read until the job notices it */
+            kill(pid, SIGTERM);
+            connected = false;
+        }
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            exit(1);
+        }
+    }
+
+    if (connected) {
+        send_status(conn, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), log);
+    }
+
+    exit(0);
+}
+
+static int open_socket(const char *socket_name)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (strlen(socket_name) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, _("%s: socket name is too long\n"), socket_name);
+        exit(1);
+    }
+    strcpy(addr.sun_path, socket_name);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        exit(1);
+    }
+
+    /* Remove a socket left by a previous server */
+    struct stat st;
+    if (!stat(socket_name, &st) && S_ISSOCK(st.st_mode)) {
+        unlink(socket_name);
+    }
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, 16)) {
+        perror(socket_name);
+        exit(1);
+    }
+
+    return sock;
+}
+
+/* Reap finished connection processes. Returns number of processes reaped. */
+static int reap_children(bool block)
+{
+    int n = 0;
+    int status;
+
+    while (waitpid(-1, &status, block && !n ? 0 : WNOHANG) > 0) {
+        n++;
+    }
+
+    return n;
+}
+
+void serve(const char *prog, const char *socket_name, int max_jobs, serve_job_func func)
+{
+    int sock = open_socket(socket_name);
+    int running = 0;
+
+    /* Writes to closed connections should fail instead of killing the process */
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        running -= reap_children(running >= max_jobs);
+        if (running >= max_jobs) {
+            continue;
+        }
+
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                perror("accept");
+                exit(1);
+            }
+            continue;
+        }
+
+        /* Buffered output should not be repeated by children */
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+        } else if (pid == 0) {
+            close(sock);
+            handle_connection(conn, prog, func);
+        } else {
+            running++;
+        }
+
+        close(conn);
+    }
+}
@@ -0,0 +1,27 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef SERVE_H
+#define SERVE_H
+
+/*
+ * Runs a job in a new process. Arguments are options of the job,
+ * preceded by the program name. Output should be written to 'fd'.
+ * Returns exit status of the job.
+ */
+typedef int (*serve_job_func)(int argc, char **argv, int fd);
+
+/*
+ * Accept jobs on the Unix socket and run at most 'max_jobs' of them at once.
+ * Never returns.
+ *
+ * A request is a list of arguments, each terminated by a zero byte, and
+ * ended by an empty argument. The response is the output in frames of
+ * a 4 byte big endian length followed by data, ended by an empty frame.
+ * It is followed by the exit status and by the length and text of
+ * messages printed by the job, both lengths are 4 byte big endian.
+ */
+void serve(const char *prog, const char *socket_name, int max_jobs, serve_job_func func);
+
+#endif
@@ -4,8 +4,26 @@
  */
 #ifndef STATIC_UNICODE_BLOCKS_H
 #define STATIC_UNICODE_BLOCKS_H
+#include <stdint.h>
 #include "unicode_blocks.h"
 
+/*
+ * Blocks generated from Blocks.txt at build time, with a lookup
+ * table described in unicode_blocks.h.
+ */
 extern const struct unicode_block static_unicode_blocks[];
+extern const uint16_t static_unicode_block_pages[BLOCK_LOOKUP_PAGES];
+extern const uint16_t static_unicode_block_rows[][16];
+
+/*
+ * Find index of the static Unicode block that contains the given character.
+ * Returns -1 if there is no such block.
+ */
+static inline int static_unicode_block_index(unsigned long charcode)
+{
+    const struct block_lookup lookup = {static_unicode_block_pages, static_unicode_block_rows};
+
+    return block_lookup_index(&lookup, charcode);
+}
 
 #endif
@@ -0,0 +1,226 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "stats.h"
+#include "report.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib.h>
+
+/* Totals for the pages of one block of one face */
+struct block_stats {
+    int face;
+    const struct unicode_block *block;
+    int pages;
+    long glyphs;
+    int64_t draw_us;
+};
+
+G_LOCK_DEFINE_STATIC(stats);
+static bool enabled;
+static long counters[STATS_COUNTERS];
+static struct block_stats *blocks;
+static int nblocks;
+static int nblocks_alloc;
+
+static const char *const counter_names[STATS_COUNTERS] = {
+    "layouts", "glyphs", "charcodes", "fills", "pages", "finish_us",
+};
+
+void stats_enable(void) { enabled = true; }
+
+bool stats_enabled(void) { return enabled; }
+
+void stats_add(enum stats_counter counter, long n)
+{
+    if (!enabled) {
+        return;
+    }
+
+    G_LOCK(stats);
+    counters[counter] += n;
+    G_UNLOCK(stats);
+}
+
+/*
+ * Find statistics of the block, or add them. Pages of a block are usually
+ * drawn one after another, so the search starts from the last entry.
+ */
+static struct block_stats *find_block_stats(int face, const struct unicode_block *block)
+{
+    for (int i = nblocks - 1; i >= 0; i--) {
+        if (blocks[i].face == face && blocks[i].block == block) {
+            return blocks + i;
+        }
+    }
+
+    if (nblocks == nblocks_alloc) {
+        int new_alloc = nblocks_alloc + 64;
+        struct block_stats *new_blocks = realloc(blocks, new_alloc * sizeof(struct block_stats));
+        if (!new_blocks) {
+            perror("realloc");
+            exit(9);
+        }
+        blocks = new_blocks;
+        nblocks_alloc = new_alloc;
+    }
+
+    struct block_stats *b = blocks + nblocks++;
+    b->face = face;
+    b->block = block;
+    b->pages = 0;
+    b->glyphs = 0;
+    b->draw_us = 0;
+
+    return b;
+}
+
+/*
+ * Account a drawn page of the block.
+ */
+void stats_page(int face, const struct unicode_block *block, long glyphs, int64_t draw_us)
+{
+    if (!enabled) {
+        return;
+    }
+
+    G_LOCK(stats);
+    struct block_stats *b = find_block_stats(face, block);
+    b->pages++;
+    b->glyphs += glyphs;
+    b->draw_us += draw_us;
+    counters[STATS_PAGES]++;
+    G_UNLOCK(stats);
+}
+
+static int compare_block_stats(const void *a, const void *b)
+{
+    const struct block_stats *sa = a;
+    const struct block_stats *sb = b;
+
+    if (sa->face != sb->face) {
+        return sa->face < sb->face ? -1 : 1;
+    }
+
+    return sa->block->start < sb->block->start ? -1 : sa->block->start > sb->block->start;
+}
+
+/*
+ * Write collected statistics as a JSON object. Blocks are sorted by face
+ * and by position, so the order does not depend on the number of threads.
+ */
+void stats_write(const char *file_name, const char *font_file_name, int64_t wall_us, long cpu_us)
+{
+    FILE *f = fopen(file_name, "w");
+    if (!f) {
+        perror(file_name);
+        exit(1);
+    }
+
+    struct rusage usage;
+    long peak_rss = getrusage(RUSAGE_SELF, &usage) ? -1 : usage.ru_maxrss;
+#ifdef __APPLE__
+    /* macOS reports the size in bytes */
+    if (peak_rss > 0) {
+        peak_rss /= 1024;
+    }
+#endif
+
+    fprintf(f, "{\n  \"font\": ");
+    print_json_string(f, font_file_name);
+    fprintf(f, ",\n  \"wall_us\": %" PRId64 ",\n  \"cpu_us\": %ld,\n  \"peak_rss_kb\": %ld,\n",
+            wall_us, cpu_us, peak_rss);
+
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        fprintf(f, "  \"%s\": %ld,\n", counter_names[i], counters[i]);
+    }
+
+    qsort(blocks, nblocks, sizeof(struct block_stats), compare_block_stats);
+
+    fprintf(f, "  \"blocks\": [");
+    for (int i = 0; i < nblocks; i++) {
+        const struct block_stats *b = blocks + i;
+
+        fprintf(f, "%s\n    {\"face\": %d, \"name\": ", i ? "," : "", b->face);
+        print_json_string(f, b->block->name);
+        fprintf(f,
+                ", \"start\": %lu, \"end\": %lu, \"pages\": %d, \"glyphs\": %ld, "
+                "\"draw_us\": %" PRId64 "}",
+                b->block->start, b->block->end, b->pages, b->glyphs, b->draw_us);
+    }
+    fprintf(f, "%s]\n}\n", nblocks ? "\n  " : "");
+
+    if (fclose(f)) {
+        perror(file_name);
+        exit(1);
+    }
+}
+
+G_LOCK_DEFINE_STATIC(progress);
+static int progress_fd = -1;
+static int progress_face;
+static int progress_done;
+static int progress_total;
+
+void progress_open(int fd) { progress_fd = fd; }
+
+/*
+ * Write a line with a single write() call, so lines written by several
+ * processes sharing the descriptor are not mixed. Reporting stops if the
+ * descriptor cannot be written to.
+ */
+static void progress_write(const char *line)
+{
+    size_t len = strlen(line);
+
+    while (len) {
+        ssize_t n = write(progress_fd, line, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            perror("progress");
+            progress_fd = -1;
+            return;
+        }
+        line += n;
+        len -= n;
+    }
+}
+
+void progress_start(int face, int npages)
+{
+    if (progress_fd < 0) {
+        return;
+    }
+
+    G_LOCK(progress);
+    progress_face = face;
+    progress_done = 0;
+    progress_total = npages;
+
+    char *line = g_strdup_printf("face\t%d\t%d\n", face, npages);
+    progress_write(line);
+    g_free(line);
+    G_UNLOCK(progress);
+}
+
+void progress_advance(int npages, const char *block)
+{
+    if (progress_fd < 0) {
+        return;
+    }
+
+    G_LOCK(progress);
+    progress_done += npages;
+
+    char *line = g_strdup_printf("page\t%d\t%d\t%d\t%s\n", progress_face, progress_done,
+                                 progress_total, block);
+    progress_write(line);
+    g_free(line);
+    G_UNLOCK(progress);
+}
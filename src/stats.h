@@ -0,0 +1,42 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "unicode_blocks.h"
+
+enum stats_counter {
+    STATS_LAYOUTS,   /* Pango layouts created */
+    STATS_GLYPHS,    /* glyphs shown in table cells */
+    STATS_CHARCODES, /* character code labels drawn */
+    STATS_FILLS,     /* rectangles filled with cell backgrounds */
+    STATS_PAGES,     /* pages drawn */
+    STATS_FINISH_US, /* time spent finishing output files */
+    STATS_COUNTERS,
+};
+
+/*
+ * Statistics are only collected after stats_enable() is called.
+ * All functions can be called from several threads.
+ */
+void stats_enable(void);
+bool stats_enabled(void);
+void stats_add(enum stats_counter counter, long n);
+void stats_page(int face, const struct unicode_block *block, long glyphs, int64_t draw_us);
+void stats_write(const char *file_name, const char *font_file_name, int64_t wall_us, long cpu_us);
+
+/*
+ * Progress is written as lines of tab separated fields to a file descriptor:
+ * "face INDEX PAGES" when drawing of a face starts, and
+ * "page INDEX DONE PAGES BLOCK" when pages are drawn.
+ */
+void progress_open(int fd);
+void progress_start(int face, int npages);
+void progress_advance(int npages, const char *block);
+
+#endif
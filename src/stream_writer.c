@@ -0,0 +1,182 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "stream_writer.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#define STREAM_BUFFER_SIZE (1024 * 1024)
+/* Limits memory used when the output is slower than drawing */
+#define STREAM_MAX_BUFFERS 4
+
+struct stream_buffer {
+    size_t len; /* buffers with no data mark the end of the stream */
+    unsigned char data[STREAM_BUFFER_SIZE];
+};
+
+struct stream_writer {
+    int fd;
+    bool close_fd;
+    GThread *thread;
+    GAsyncQueue *full_buffers;
+    GAsyncQueue *free_buffers;
+    int nbuffers;
+    struct stream_buffer *current;
+    int64_t bytes;
+    gint error; /* errno of the first failed write */
+};
+
+static bool write_all(int fd, const unsigned char *data, size_t len)
+{
+    while (len) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/*
+ * Writer thread. Buffers are returned to the free queue after they are
+ * written. After an error the remaining data is discarded.
+ */
+static gpointer writer_thread(gpointer data)
+{
+    struct stream_writer *writer = data;
+
+    for (;;) {
+        struct stream_buffer *buffer = g_async_queue_pop(writer->full_buffers);
+        size_t len = buffer->len;
+
+        if (len && !g_atomic_int_get(&writer->error)
+            && !write_all(writer->fd, buffer->data, len)) {
+            g_atomic_int_set(&writer->error, errno);
+        }
+
+        buffer->len = 0;
+        g_async_queue_push(writer->free_buffers, buffer);
+
+        if (!len) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+struct stream_writer *stream_writer_new(int fd, bool close_fd)
+{
+    struct stream_writer *writer = calloc(1, sizeof(struct stream_writer));
+    if (!writer) {
+        perror("calloc");
+        exit(9);
+    }
+
+    writer->fd = fd;
+    writer->close_fd = close_fd;
+    writer->full_buffers = g_async_queue_new();
+    writer->free_buffers = g_async_queue_new();
+    writer->thread = g_thread_new("writer", writer_thread, writer);
+
+    return writer;
+}
+
+/*
+ * Get an empty buffer. New buffers are allocated until the limit is
+ * reached, then drawing waits for the writer thread.
+ */
+static struct stream_buffer *get_buffer(struct stream_writer *writer)
+{
+    struct stream_buffer *buffer = g_async_queue_try_pop(writer->free_buffers);
+
+    if (!buffer && writer->nbuffers < STREAM_MAX_BUFFERS) {
+        buffer = malloc(sizeof(struct stream_buffer));
+        if (!buffer) {
+            perror("malloc");
+            exit(9);
+        }
+        buffer->len = 0;
+        writer->nbuffers++;
+    } else if (!buffer) {
+        buffer = g_async_queue_pop(writer->free_buffers);
+    }
+
+    return buffer;
+}
+
+/*
+ * Write function for cairo_*_surface_create_for_stream().
+ */
+cairo_status_t stream_writer_write(void *closure, const unsigned char *data, unsigned int length)
+{
+    struct stream_writer *writer = closure;
+
+    if (g_atomic_int_get(&writer->error)) {
+        return CAIRO_STATUS_WRITE_ERROR;
+    }
+
+    while (length) {
+        if (!writer->current) {
+            writer->current = get_buffer(writer);
+        }
+
+        struct stream_buffer *buffer = writer->current;
+        size_t n = MIN(length, STREAM_BUFFER_SIZE - buffer->len);
+        memcpy(buffer->data + buffer->len, data, n);
+        buffer->len += n;
+        data += n;
+        length -= n;
+        writer->bytes += n;
+
+        if (buffer->len == STREAM_BUFFER_SIZE) {
+            g_async_queue_push(writer->full_buffers, buffer);
+            writer->current = NULL;
+        }
+    }
+
+    return CAIRO_STATUS_SUCCESS;
+}
+
+int64_t stream_writer_bytes(const struct stream_writer *writer) { return writer->bytes; }
+
+/*
+ * Write the remaining data and free the writer.
+ * Returns 0 on success, or errno of the first failed write or close.
+ */
+int stream_writer_close(struct stream_writer *writer)
+{
+    if (writer->current && writer->current->len) {
+        g_async_queue_push(writer->full_buffers, writer->current);
+        writer->current = NULL;
+    }
+
+    struct stream_buffer *end = writer->current ? writer->current : get_buffer(writer);
+    g_async_queue_push(writer->full_buffers, end);
+    g_thread_join(writer->thread);
+
+    int error = writer->error;
+    if (writer->close_fd && close(writer->fd) && !error) {
+        error = errno;
+    }
+
+    struct stream_buffer *buffer;
+    while ((buffer = g_async_queue_try_pop(writer->free_buffers))) {
+        free(buffer);
+    }
+
+    g_async_queue_unref(writer->full_buffers);
+    g_async_queue_unref(writer->free_buffers);
+    free(writer);
+
+    return error;
+}
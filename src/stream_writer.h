@@ -0,0 +1,24 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef STREAM_WRITER_H
+#define STREAM_WRITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <cairo.h>
+
+/*
+ * Buffered writer for cairo streams. Data is collected into large
+ * buffers, that are written to the file descriptor by a background
+ * thread, so output overlaps with drawing.
+ */
+struct stream_writer;
+
+struct stream_writer *stream_writer_new(int fd, bool close_fd);
+cairo_status_t stream_writer_write(void *closure, const unsigned char *data, unsigned int length);
+int64_t stream_writer_bytes(const struct stream_writer *writer);
+int stream_writer_close(struct stream_writer *writer);
+
+#endif
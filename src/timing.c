@@ -0,0 +1,117 @@
+/* Copyright © Євгеній Мещеряков <eugen@debian.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+#include "timing.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+
+/*
+ * Timings are appended to a CSV file, one row per phase, so results
+ * of several runs can be collected into the same file.
+ */
+
+static FILE *timing_file;
+static const char *timing_font;
+static int timing_face;
+
+static void print_csv_string(const char *s)
+{
+    putc('"', timing_file);
+    for (; *s; s++) {
+        if (*s == '"') {
+            putc('"', timing_file);
+        }
+        putc(*s, timing_file);
+    }
+    putc('"', timing_file);
+}
+
+static void print_row(const char *phase, const char *detail)
+{
+    print_csv_string(timing_font);
+    fprintf(timing_file, ",%d,%s,", timing_face, phase);
+    print_csv_string(detail ? detail : "");
+}
+
+void timing_open(const char *file_name, const char *font_file_name)
+{
+    timing_file = fopen(file_name, "a");
+    if (!timing_file) {
+        perror(file_name);
+        exit(1);
+    }
+
+    fseek(timing_file, 0, SEEK_END);
+    if (ftell(timing_file) == 0) {
+        fprintf(timing_file, "font,face,phase,detail,wall_us,cpu_us,count\n");
+    }
+
+    timing_font = font_file_name;
+}
+
+bool timing_enabled(void) { return timing_file != NULL; }
+
+void timing_set_face(int face) { timing_face = face; }
+
+void timing_start(struct timing *t)
+{
+    t->wall = g_get_monotonic_time();
+    t->cpu = clock();
+}
+
+/*
+ * Get wall clock and CPU time in microseconds since 't' was started.
+ * CPU time is for the whole process, including all threads.
+ */
+void timing_elapsed(const struct timing *t, int64_t *wall, long *cpu)
+{
+    *wall = g_get_monotonic_time() - t->wall;
+    *cpu = (long)((double)(clock() - t->cpu) * 1000000 / CLOCKS_PER_SEC);
+}
+
+/*
+ * Write wall clock and CPU time since 't' was started, and an optional
+ * counter (negative if none).
+ */
+void timing_record(const struct timing *t, const char *phase, const char *detail, long count)
+{
+    if (!timing_file) {
+        return;
+    }
+
+    int64_t wall;
+    long cpu;
+    timing_elapsed(t, &wall, &cpu);
+
+    print_row(phase, detail);
+    fprintf(timing_file, ",%" PRId64 ",%ld,", wall, cpu);
+    if (count >= 0) {
+        fprintf(timing_file, "%ld", count);
+    }
+    putc('\n', timing_file);
+}
+
+/*
+ * Write a counter that is not related to time.
+ */
+void timing_count(const char *phase, long count)
+{
+    if (!timing_file) {
+        return;
+    }
+
+    print_row(phase, NULL);
+    fprintf(timing_file, ",,,%ld\n", count);
+}
+
+void timing_close(void)
+{
+    if (timing_file && fclose(timing_file)) {
+        perror("fclose");
+        exit(1);
+    }
+
+    timing_file = NULL;
+}
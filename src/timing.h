@@ -0,0 +1,27 @@
+/*
+ * Author: Ievgenii Meshcheriakov <eugen@debian.org>
+ * SPDX-License-Identifier: CC-PDDC
+ */
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Start of a measured phase */
+struct timing {
+    int64_t wall;
+    clock_t cpu;
+};
+
+void timing_open(const char *file_name, const char *font_file_name);
+bool timing_enabled(void);
+void timing_set_face(int face);
+void timing_start(struct timing *t);
+void timing_elapsed(const struct timing *t, int64_t *wall, long *cpu);
+void timing_record(const struct timing *t, const char *phase, const char *detail, long count);
+void timing_count(const char *phase, long count);
+void timing_close(void);
+
+#endif
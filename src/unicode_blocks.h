@@ -5,6 +5,8 @@
 #ifndef UNICODE_BLOCKS_H
 #define UNICODE_BLOCKS_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 struct unicode_block {
@@ -13,6 +15,43 @@ struct unicode_block {
     const char *name;
 };
 
+/*
+ * Blocks are looked up using a two level table. The first level maps
+ * a page of 256 characters to a row of the second level, that maps
+ * each 16 characters of the page to the block index plus one.
+ * Zero is used for characters that do not belong to any block.
+ */
+#define BLOCK_LOOKUP_PAGES (0x110000 / 256)
+
+struct block_lookup {
+    const uint16_t *pages;
+    const uint16_t (*rows)[16];
+};
+
+/*
+ * Find index of the block that contains the given character.
+ * Returns -1 if there is no such block.
+ */
+static inline int block_lookup_index(const struct block_lookup *lookup, unsigned long charcode)
+{
+    if (charcode >= BLOCK_LOOKUP_PAGES * 256) {
+        return -1;
+    }
+
+    uint16_t row = lookup->pages[charcode / 256];
+    return lookup->rows[row][(charcode / 16) % 16] - 1;
+}
+
 struct unicode_block *read_blocks(const char *file_name, int *n);
+int sort_blocks(struct unicode_block *blocks, int n);
+const struct unicode_block *find_block(const struct unicode_block *blocks, int n,
+                                       unsigned long charcode);
+bool blocks_aligned(const struct unicode_block *blocks, int n);
+int build_block_lookup(const struct unicode_block *blocks, int n, uint16_t *pages,
+                       uint16_t (*rows)[16]);
+int write_blocks_cache(const char *file_name, const char *source_name,
+                       const struct unicode_block *blocks, int n);
+struct unicode_block *read_blocks_cache(const char *file_name, const char *source_name, int *n,
+                                        struct block_lookup *lookup);
 
 #endif